@@ -0,0 +1,161 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+#include "lru_cache.h"
+#include "sharded_lru_cache.h"
+
+// Mixed Get/Set load over a key space twice as large as the cache, so that
+// about half of the Sets evict. Throughput should not depend on cache size.
+double BenchSetGet(size_t cache_size, size_t operations) {
+    LruCache cache(cache_size);
+    std::string value;
+
+    std::vector<std::string> keys;
+    keys.reserve(2 * cache_size);
+    for (size_t i = 0; i < 2 * cache_size; ++i) {
+        keys.push_back(std::to_string(i));
+    }
+    for (size_t i = 0; i < cache_size; ++i) {
+        cache.Set(keys[i], "foo");
+    }
+
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<size_t> distribution(0, keys.size() - 1);
+    std::vector<size_t> indices(operations);
+    for (size_t& index : indices) {
+        index = distribution(generator);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < operations; ++i) {
+        if (i % 2 == 0) {
+            cache.Set(keys[indices[i]], "bar");
+        } else {
+            cache.Get(keys[indices[i]], &value);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return operations / elapsed.count();
+}
+
+// Warm restart: Restore from a Dump against replaying every entry with Set.
+void BenchRestore(size_t cache_size) {
+    const std::string path = "lru_cache_bench.bin";
+    std::vector<std::pair<std::string, std::string>> entries;
+    LruCache cache(cache_size);
+    for (size_t i = 0; i < cache_size; ++i) {
+        entries.emplace_back(std::to_string(i), std::string(32, 'x'));
+        cache.Set(entries.back().first, entries.back().second);
+    }
+    cache.Dump(path);
+
+    auto start = std::chrono::steady_clock::now();
+    LruCache restored(cache_size);
+    restored.Restore(path);
+    std::chrono::duration<double> restore_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    LruCache replayed(cache_size);
+    for (auto& entry : entries) {
+        replayed.Set(entry.first, entry.second);
+    }
+    std::chrono::duration<double> replay_time = std::chrono::steady_clock::now() - start;
+
+    std::cout << "restore " << cache_size << ": " << restore_time.count() << " s, replay "
+              << replay_time.count() << " s" << std::endl;
+    std::remove(path.c_str());
+}
+
+// What callers did before ShardedLruCache: one LruCache behind one mutex.
+class LockedLruCache {
+public:
+    explicit LockedLruCache(size_t max_size) : cache_(max_size) {}
+
+    void Set(const std::string& key, const std::string& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_.Set(key, value);
+    }
+
+    bool Get(const std::string& key, std::string* value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.Get(key, value);
+    }
+
+private:
+    std::mutex mutex_;
+    LruCache cache_;
+};
+
+// 90% Gets, 10% Sets from every thread over a shared key space.
+template <class Cache>
+double BenchThreads(Cache* cache, size_t threads_count, size_t operations_per_thread,
+                    const std::vector<std::string>& keys) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads_count; ++t) {
+        threads.emplace_back([cache, t, operations_per_thread, &keys] {
+            std::mt19937 generator(t);
+            std::uniform_int_distribution<size_t> distribution(0, keys.size() - 1);
+            std::string value;
+            for (size_t i = 0; i < operations_per_thread; ++i) {
+                const std::string& key = keys[distribution(generator)];
+                if (i % 10 == 0) {
+                    cache->Set(key, "bar");
+                } else {
+                    cache->Get(key, &value);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return threads_count * operations_per_thread / elapsed.count();
+}
+
+void BenchScaling() {
+    const size_t kCacheSize = 100000;
+    const size_t kOperationsPerThread = 200000;
+
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 2 * kCacheSize; ++i) {
+        keys.push_back(std::to_string(i));
+    }
+
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+        LockedLruCache locked(kCacheSize);
+        ShardedLruCache sharded(kCacheSize, 64);
+        for (size_t i = 0; i < kCacheSize; ++i) {
+            locked.Set(keys[i], "foo");
+            sharded.Set(keys[i], "foo");
+        }
+        std::cout << "threads " << threads << ": mutex "
+                  << static_cast<size_t>(BenchThreads(&locked, threads, kOperationsPerThread, keys))
+                  << " ops/s, sharded "
+                  << static_cast<size_t>(BenchThreads(&sharded, threads, kOperationsPerThread, keys))
+                  << " ops/s" << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t max_size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+    const size_t kOperations = 2000000;
+
+    for (size_t size = 1000; size <= max_size; size *= 10) {
+        std::cout << "size " << size << ": "
+                  << static_cast<size_t>(BenchSetGet(size, kOperations)) << " ops/s" << std::endl;
+    }
+
+    BenchRestore(std::min<size_t>(max_size, 1000000));
+    BenchScaling();
+    return 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Approximate access counts for TinyLFU admission: a count-min sketch of
+// 4-bit counters packed sixteen to a 64-bit word (the CountingDict idea
+// from Algo/Contest4, with narrower counters and word-sized packing).
+// Every key owns one counter in each of four rows; its frequency is the
+// smallest of them. Once the sketch has seen ten times its capacity worth
+// of increments, all counters are halved so that old popularity fades.
+class FrequencySketch {
+public:
+    explicit FrequencySketch(size_t capacity = 0) {
+        EnsureCapacity(capacity);
+    }
+
+    // Grows the table to keep estimates accurate for `capacity` keys.
+    // Growing keeps the counts: a key's counter moves to the same word or
+    // to its copy in the new upper half, and both start as the old word.
+    void EnsureCapacity(size_t capacity) {
+        if (capacity <= table_.size() && !table_.empty()) {
+            return;
+        }
+        size_t words = 1;
+        while (words < capacity) {
+            words *= 2;
+        }
+        if (words <= table_.size()) {
+            return;
+        }
+        if (table_.empty()) {
+            table_.assign(words, 0);
+        } else {
+            size_t old_words = table_.size();
+            table_.resize(words);
+            for (size_t i = old_words; i < words; ++i) {
+                table_[i] = table_[i & mask_];
+            }
+        }
+        mask_ = words - 1;
+        sample_size_ = 10 * words;
+    }
+
+    void Increment(uint64_t hash) {
+        bool added = false;
+        for (int row = 0; row < kRows; ++row) {
+            uint64_t& word = table_[index_(hash, row)];
+            int shift = offset_(hash, row);
+            if (((word >> shift) & kCounterMax) != kCounterMax) {
+                word += uint64_t(1) << shift;
+                added = true;
+            }
+        }
+        if (added && ++additions_ == sample_size_) {
+            reset_();
+        }
+    }
+
+    int Frequency(uint64_t hash) const {
+        int frequency = kCounterMax;
+        for (int row = 0; row < kRows; ++row) {
+            int count = (table_[index_(hash, row)] >> offset_(hash, row)) & kCounterMax;
+            if (count < frequency) {
+                frequency = count;
+            }
+        }
+        return frequency;
+    }
+
+private:
+    static const int kRows = 4;
+    static const uint64_t kCounterMax = 15;
+
+    std::vector<uint64_t> table_;
+    size_t mask_ = 0;
+    size_t sample_size_ = 0;
+    size_t additions_ = 0;
+
+    size_t index_(uint64_t hash, int row) const {
+        static const uint64_t kSeeds[kRows] = {
+            0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull,
+            0x9ae16a3b2f90404full, 0xcbf29ce484222325ull
+        };
+        uint64_t h = (hash + kSeeds[row]) * kSeeds[row];
+        return (h ^ (h >> 32)) & mask_;
+    }
+
+    // Row r uses counters 4r..4r+3 of a word, picked by two bits of the hash.
+    int offset_(uint64_t hash, int row) const {
+        return ((row << 2) + ((hash >> (row << 1)) & 3)) << 2;
+    }
+
+    void reset_() {
+        for (uint64_t& word : table_) {
+            word = (word >> 1) & 0x7777777777777777ull;
+        }
+        additions_ /= 2;
+    }
+};
@@ -0,0 +1,80 @@
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "lru_cache.h"
+
+// Replays a trace of keys, one per line, as read-through lookups:
+// Get, and Set on a miss. Without a trace file a synthetic one is used:
+// Zipf-distributed requests over a hot set, interrupted every so often by
+// a long scan of keys that are never seen again.
+
+std::vector<std::string> ReadTrace(const char* path) {
+    std::vector<std::string> trace;
+    std::ifstream in(path);
+    std::string key;
+    while (std::getline(in, key)) {
+        trace.push_back(key);
+    }
+    return trace;
+}
+
+std::vector<std::string> SyntheticTrace() {
+    const size_t kHotKeys = 100000;
+    const size_t kRequests = 4000000;
+    const size_t kScanEvery = 500000;
+    const size_t kScanLength = 200000;
+
+    std::vector<double> weights(kHotKeys);
+    for (size_t i = 0; i < kHotKeys; ++i) {
+        weights[i] = 1.0 / std::pow(i + 1, 0.9);
+    }
+    std::discrete_distribution<size_t> zipf(weights.begin(), weights.end());
+    std::mt19937 generator(42);
+
+    std::vector<std::string> trace;
+    trace.reserve(kRequests + kRequests / kScanEvery * kScanLength);
+    size_t scanned = 0;
+    for (size_t i = 0; i < kRequests; ++i) {
+        if (i % kScanEvery == kScanEvery - 1) {
+            for (size_t j = 0; j < kScanLength; ++j) {
+                trace.push_back("scan" + std::to_string(scanned++));
+            }
+        }
+        trace.push_back(std::to_string(zipf(generator)));
+    }
+    return trace;
+}
+
+double HitRate(LruCache* cache, const std::vector<std::string>& trace) {
+    std::string value;
+    size_t hits = 0;
+    for (const std::string& key : trace) {
+        if (cache->Get(key, &value)) {
+            ++hits;
+        } else {
+            cache->Set(key, key);
+        }
+    }
+    return static_cast<double>(hits) / trace.size();
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> trace = argc > 1 ? ReadTrace(argv[1]) : SyntheticTrace();
+    if (trace.empty()) {
+        std::cerr << "empty trace" << std::endl;
+        return 1;
+    }
+
+    for (size_t size = 1000; size <= 100000; size *= 10) {
+        LruCache lru(size);
+        LruCache tiny_lfu(size, nullptr, LruCache::Admission::kTinyLfu);
+        std::cout << "size " << size
+                  << ": lru " << HitRate(&lru, trace)
+                  << ", tinylfu " << HitRate(&tiny_lfu, trace) << std::endl;
+    }
+    return 0;
+}
@@ -1,51 +1,678 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <list>
 #include <unordered_map>
-#include <set>
-#include <iostream>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
 
-class LruCache {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frequency_sketch.h"
+#include "timer_wheel.h"
+
+// How LruCache looks up, weighs and saves keys and values of type T.
+// View is what Get takes and what the index stores: the type itself by
+// default, std::string_view for strings, so that the index points into the
+// cached key and lookups need no std::string. Snapshots copy trivially
+// copyable types byte for byte (Data() points at Bytes() bytes); other
+// types need a specialization.
+template <class T>
+struct LruTraits {
+    typedef T View;
+
+    static size_t Bytes(const T&) {
+        return sizeof(T);
+    }
+
+    static const char* Data(const T& x) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "specialize LruTraits to snapshot this type");
+        return reinterpret_cast<const char*>(&x);
+    }
+
+    static bool FromBytes(const char* data, size_t size, T* x) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "specialize LruTraits to snapshot this type");
+        if (size != sizeof(T)) {
+            return false;
+        }
+        memcpy(static_cast<void*>(x), data, size);
+        return true;
+    }
+};
+
+template <>
+struct LruTraits<std::string> {
+    typedef std::string_view View;
+
+    static size_t Bytes(const std::string& x) {
+        return x.size();
+    }
+
+    static const char* Data(const std::string& x) {
+        return x.data();
+    }
+
+    static bool FromBytes(const char* data, size_t size, std::string* x) {
+        x->assign(data, size);
+        return true;
+    }
+};
+
+template <class Key, class Value>
+class BasicLruCache {
 public:
-    LruCache(size_t max_size) {
-        max_size_ = max_size;
+    typedef typename LruTraits<Key>::View KeyView;
+
+    // Tells how much of the capacity an entry takes.
+    typedef std::function<size_t(const Key& key, const Value& value)> Weigher;
+
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    typedef std::chrono::steady_clock::duration Duration;
+    typedef std::function<TimePoint()> Clock;
+
+    // kTinyLfu puts a W-TinyLFU filter in front of the LRU: new entries go
+    // through a small LRU window (1% of the capacity), and an entry pushed
+    // out of the window only replaces the main cache's victim if the key has
+    // been seen more often. One pass over cold keys therefore cannot flush
+    // the hot set.
+    enum class Admission {
+        kNone,
+        kTinyLfu
+    };
+
+    static size_t KeyValueBytes(const Key& key, const Value& value) {
+        return LruTraits<Key>::Bytes(key) + LruTraits<Value>::Bytes(value);
+    }
+
+    // Capacity is a number of entries.
+    BasicLruCache(size_t max_size) {
+        init_(max_size, Admission::kNone);
+    }
+
+    // Capacity is a budget in weigher units: Set evicts entries until the
+    // total weight fits. An entry heavier than the whole budget is not
+    // cached: Set drops the key's old value and leaves the other entries
+    // alone. Every entry weighs at least 1, so at most max_weight of them
+    // are kept. A null weigher counts entries.
+    BasicLruCache(size_t max_weight, Weigher weigher, Admission admission = Admission::kNone)
+        : weigher_(std::move(weigher)) {
+        init_(max_weight, admission);
+    }
+
+    static BasicLruCache WithByteBudget(size_t max_bytes, Weigher weigher = KeyValueBytes) {
+        return BasicLruCache(max_bytes, std::move(weigher));
+    }
+
+    BasicLruCache(const BasicLruCache&) = delete;
+    BasicLruCache& operator=(const BasicLruCache&) = delete;
+
+    // A moved-from cache is empty and keeps its capacity, admission,
+    // weigher, clock and default TTL, so it can still be used.
+    BasicLruCache(BasicLruCache&& other) {
+        *this = std::move(other);
     }
 
-    void Set(const std::string& key, const std::string& value) {
-        hashtable_[key] = value;
-        usage_.push_back(key);
-        if (hashtable_.size() > max_size_) {
-            lru_();
+    BasicLruCache& operator=(BasicLruCache&& other) {
+        if (this == &other) {
+            return *this;
         }
+        admission_ = other.admission_;
+        max_weight_ = other.max_weight_;
+        window_max_ = other.window_max_;
+        main_max_ = other.main_max_;
+        protected_max_ = other.protected_max_;
+        weight_ = other.weight_;
+        peak_weight_ = other.peak_weight_;
+        window_weight_ = other.window_weight_;
+        probation_weight_ = other.probation_weight_;
+        protected_weight_ = other.protected_weight_;
+        weigher_ = other.weigher_;
+        clock_ = other.clock_;
+        default_ttl_ = other.default_ttl_;
+        wheel_ = std::move(other.wheel_);
+        sketch_ = std::move(other.sketch_);
+        hashtable_ = std::move(other.hashtable_);
+        window_ = std::move(other.window_);
+        probation_ = std::move(other.probation_);
+        protected_ = std::move(other.protected_);
+
+        other.clear_();
+        other.peak_weight_ = 0;
+        other.sketch_ = FrequencySketch();
+        other.init_(other.max_weight_, other.admission_);
+        return *this;
     }
 
-    bool Get(const std::string& key, std::string* value) {
-        if (hashtable_.find(key) == hashtable_.end()) {
-            return false;
+    // TTL used by Set without an explicit one.
+    void SetDefaultTtl(Duration ttl) {
+        default_ttl_ = ttl;
+    }
+
+    // Time source for TTLs, steady_clock::now by default. A coarse clock
+    // that is cheaper to read works as long as it is monotonic. Must be set
+    // before any entry with a TTL is added.
+    void SetClock(Clock clock) {
+        clock_ = std::move(clock);
+    }
+
+    void Set(Key key, Value value) {
+        Set(std::move(key), std::move(value), default_ttl_);
+    }
+
+    // The entry expires `ttl` after this call (millisecond resolution);
+    // a zero ttl means it never expires. Updating a key restarts its TTL.
+    void Set(Key key, Value value, Duration ttl) {
+        uint64_t ttl_ticks = 0;
+        uint64_t deadline = 0;
+        if (ttl > Duration::zero() || wheel_.Size() > 0) {
+            uint64_t now = now_();
+            expire_(now);
+            if (ttl > Duration::zero()) {
+                ttl_ticks = to_ticks_(ttl + std::chrono::milliseconds(1) - Duration(1));
+                deadline = now + ttl_ticks;
+            }
+        }
+
+        size_t weight = weigh_(key, value);
+        size_t hash = record_(key);
+        auto it = hashtable_.find(key);
+        if (weight > max_entry_weight_()) {
+            // Making room for it would evict everything else first.
+            if (it != hashtable_.end()) {
+                erase_(it->second);
+            }
+            return;
+        }
+        typename UsageList::iterator entry;
+        if (it != hashtable_.end()) {
+            entry = it->second;
+            segment_weight_(entry->segment) -= entry->weight;
+            segment_weight_(entry->segment) += weight;
+            weight_ = weight_ - entry->weight + weight;
+            entry->value = std::move(value);
+            entry->weight = weight;
+            touch_(entry);
+        } else {
+            window_.emplace_front(std::move(key), std::move(value), weight, hash);
+            entry = window_.begin();
+            hashtable_.emplace(entry->key, entry);
+            window_weight_ += weight;
+            weight_ += weight;
+            if (admission_ == Admission::kTinyLfu) {
+                sketch_.EnsureCapacity(hashtable_.size());
+            }
+        }
+        entry->ttl = ttl_ticks;
+        if (deadline) {
+            wheel_.Schedule(&*entry, deadline);
         } else {
-            usage_.push_back(key);
-            *value = hashtable_[key];
-            return true;
+            wheel_.Cancel(&*entry);
+        }
+        if (weight_ > peak_weight_) {
+            peak_weight_ = weight_;
+        }
+        evict_();
+    }
+
+    // An expired entry is dropped here even if Expire has not run yet.
+    bool Get(const KeyView& key, Value* value) {
+        return Get(key, [value](const Value& cached) { *value = cached; });
+    }
+
+    // Also reports how long the entry has left to live: Duration::max()
+    // if it has no TTL. `ttl`, if given, receives the TTL the entry was
+    // set with (for a restored entry, what was left of it at the Dump),
+    // zero if none.
+    bool Get(const KeyView& key, Value* value, Duration* time_left, Duration* ttl = nullptr) {
+        auto entry = find_(key);
+        if (entry == window_.end()) {
+            return false;
+        }
+        *value = entry->value;
+        *time_left = Duration::max();
+        if (entry->scheduled) {
+            uint64_t now = now_();
+            *time_left = std::chrono::milliseconds(entry->deadline > now ? entry->deadline - now : 0);
         }
+        if (ttl) {
+            *ttl = std::chrono::milliseconds(entry->ttl);
+        }
+        return true;
+    }
+
+    Duration DefaultTtl() const {
+        return default_ttl_;
+    }
+
+    // Calls visitor(const Value&) on the cached value instead of copying it
+    // out. The reference is only valid during the call, which must not
+    // modify the cache.
+    template <class Visitor,
+              class = typename std::enable_if<
+                  !std::is_pointer<typename std::decay<Visitor>::type>::value>::type>
+    bool Get(const KeyView& key, Visitor&& visitor) {
+        auto entry = find_(key);
+        if (entry == window_.end()) {
+            return false;
+        }
+        visitor(static_cast<const Value&>(entry->value));
+        return true;
+    }
+
+    // Writes all entries and their recency order to `path`, replacing it
+    // atomically. Remaining TTLs are stored relative to now; the frequency
+    // sketch is not saved. The format is native-endian, for restarting on
+    // the same machine.
+    bool Dump(const std::string& path) const {
+        std::string tmp_path = path + ".tmp";
+        std::unique_ptr<FILE, int (*)(FILE*)> file(fopen(tmp_path.c_str(), "wb"), fclose);
+        if (!file) {
+            return false;
+        }
+        uint64_t now = wheel_.Size() > 0 ? now_() : 0;
+        SnapshotHeader header = {kSnapshotMagic, kSnapshotVersion, 0};
+        for (const UsageList* list : {&window_, &probation_, &protected_}) {
+            for (const Entry& entry : *list) {
+                header.count += !expired_(entry, now);
+            }
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, file.get()) == 1;
+        for (const UsageList* list : {&window_, &probation_, &protected_}) {
+            for (const Entry& entry : *list) {
+                if (!ok || expired_(entry, now)) {
+                    continue;
+                }
+                SnapshotRecord record;
+                record.key_size = LruTraits<Key>::Bytes(entry.key);
+                record.value_size = LruTraits<Value>::Bytes(entry.value);
+                record.ttl = entry.scheduled ? entry.deadline - now : 0;
+                record.segment = entry.segment;
+                ok = fwrite(&record, sizeof(record), 1, file.get()) == 1 &&
+                     fwrite(LruTraits<Key>::Data(entry.key), 1, record.key_size,
+                            file.get()) == record.key_size &&
+                     fwrite(LruTraits<Value>::Data(entry.value), 1, record.value_size,
+                            file.get()) == record.value_size;
+            }
+        }
+        ok = fflush(file.get()) == 0 && ok;
+        file.reset();
+        if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            remove(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Refills an empty cache from a Dump: maps the file and appends entries
+    // in one sequential pass, without the lookups and eviction checks of
+    // Set. Entries beyond this cache's capacity are evicted at the end.
+    // Returns false, leaving the cache empty, if the file is missing or
+    // damaged.
+    bool Restore(const std::string& path) {
+        if (!hashtable_.empty()) {
+            return false;
+        }
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+            close(fd);
+            return false;
+        }
+        size_t size = st.st_size;
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        madvise(data, size, MADV_SEQUENTIAL);
+        bool ok = restore_(static_cast<const char*>(data), size);
+        munmap(data, size);
+        if (!ok) {
+            clear_();
+        }
+        return ok;
+    }
+
+    // Drops every expired entry. Set does this as well, so calling it is
+    // only needed to release memory while the cache is not written to.
+    void Expire() {
+        if (wheel_.Size() > 0) {
+            expire_(now_());
+        }
+    }
+
+    size_t Size() const {
+        return hashtable_.size();
+    }
+
+    // Total weight of the cached entries: bytes for a byte budget,
+    // the number of entries otherwise.
+    size_t Weight() const {
+        return weight_;
+    }
+
+    // Largest Weight() ever reached, counting an entry being inserted
+    // before the eviction it caused.
+    size_t PeakWeight() const {
+        return peak_weight_;
     }
 
 private:
-    int max_size_;
-    std::unordered_map<std::string, std::string> hashtable_;
-    std::list<std::string> usage_;
-
-    void lru_() {
-        std::set<std::string> usage_set;
-        std::string old_string;
-        for (auto it = --usage_.end(); ;--it) {
-            usage_set.insert(*it);
-            if (usage_set.size() > max_size_) {
-                old_string = *it;
-                break;
-            }
-        }
-        hashtable_.erase(old_string);
-        usage_.remove(old_string);
+    enum Segment {
+        kWindow,
+        kProbation,
+        kProtected
+    };
+
+    // Entries with a TTL are linked into wheel_ through their TimerNode,
+    // so scheduling and expiry never allocate.
+    struct Entry : TimerNode {
+        Entry(Key key, Value value, size_t weight, size_t hash)
+            : key(std::move(key)), value(std::move(value)), weight(weight), hash(hash) {}
+
+        Key key;
+        Value value;
+        size_t weight;
+        size_t hash;
+        uint64_t ttl = 0;  // in ticks, 0 for none
+        Segment segment = kWindow;
     };
+
+    // Every key has exactly one node, most recently used first within its
+    // segment; hashtable_ points straight at that node, so nothing is ever
+    // searched. Without admission everything lives in window_, which then
+    // spans the whole capacity and is a plain LRU list. With TinyLFU,
+    // entries that survive the window enter probation_ and move to
+    // protected_ on their next hit.
+    typedef std::list<Entry> UsageList;
+
+    static constexpr size_t kInitialSketchCapacity = 1 << 16;
+
+    static constexpr uint32_t kSnapshotMagic = 0x4355524c;  // "LRUC"
+    static constexpr uint32_t kSnapshotVersion = 2;
+
+    struct SnapshotHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t count;
+    };
+
+    // Followed by the key and value bytes. Entries come segment by segment
+    // (window, probation, protected), most recently used first. Sizes are
+    // 64-bit so that no value is too large to save.
+    struct SnapshotRecord {
+        uint64_t ttl;  // remaining milliseconds, 0 for none
+        uint64_t key_size;
+        uint64_t value_size;
+        uint32_t segment;
+        uint32_t padding = 0;
+    };
+
+    Admission admission_;
+    size_t max_weight_;
+    size_t window_max_;
+    size_t main_max_;
+    size_t protected_max_;
+
+    size_t weight_ = 0;
+    size_t peak_weight_ = 0;
+    size_t window_weight_ = 0;
+    size_t probation_weight_ = 0;
+    size_t protected_weight_ = 0;
+
+    Weigher weigher_;
+    Clock clock_;
+    Duration default_ttl_ = Duration::zero();
+    TimerWheel wheel_;
+    FrequencySketch sketch_;
+    std::unordered_map<KeyView, typename UsageList::iterator> hashtable_;
+    UsageList window_;
+    UsageList probation_;
+    UsageList protected_;
+
+    void init_(size_t max_weight, Admission admission) {
+        admission_ = admission;
+        max_weight_ = max_weight;
+        if (admission == Admission::kNone) {
+            window_max_ = max_weight;
+        } else {
+            window_max_ = std::max<size_t>(1, max_weight / 100);
+        }
+        main_max_ = max_weight - std::min(window_max_, max_weight);
+        protected_max_ = main_max_ - main_max_ / 5;
+        // Every entry weighs at least 1, so a bounded cache never holds
+        // more than max_weight entries and the sketch is sized once.
+        if (admission == Admission::kTinyLfu) {
+            sketch_.EnsureCapacity(std::min<size_t>(max_weight, kInitialSketchCapacity));
+        }
+    }
+
+    // Current time in wheel ticks (milliseconds).
+    uint64_t now_() const {
+        return to_ticks_((clock_ ? clock_() : std::chrono::steady_clock::now()).time_since_epoch());
+    }
+
+    static uint64_t to_ticks_(Duration duration) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    }
+
+    static bool expired_(const Entry& entry, uint64_t now) {
+        return entry.scheduled && entry.deadline <= now;
+    }
+
+    bool restore_(const char* data, size_t size) {
+        SnapshotHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != kSnapshotMagic || header.version != kSnapshotVersion ||
+            header.count > size / sizeof(SnapshotRecord)) {
+            return false;
+        }
+        hashtable_.reserve(header.count);
+        uint64_t now = 0;
+        const char* end = data + size;
+        data += sizeof(header);
+        for (uint64_t i = 0; i < header.count; ++i) {
+            SnapshotRecord record;
+            if (static_cast<size_t>(end - data) < sizeof(record)) {
+                return false;
+            }
+            memcpy(&record, data, sizeof(record));
+            data += sizeof(record);
+            uint64_t left = end - data;
+            if (record.key_size > left || record.value_size > left - record.key_size ||
+                record.segment > kProtected) {
+                return false;
+            }
+            Key key;
+            Value value;
+            if (!LruTraits<Key>::FromBytes(data, record.key_size, &key) ||
+                !LruTraits<Value>::FromBytes(data + record.key_size, record.value_size, &value)) {
+                return false;
+            }
+            data += record.key_size + record.value_size;
+            size_t weight = weigh_(key, value);
+            if (weight > max_entry_weight_()) {
+                continue;
+            }
+
+            Segment segment = admission_ == Admission::kNone ? kWindow
+                                                             : static_cast<Segment>(record.segment);
+            size_t hash = admission_ == Admission::kNone ? 0 : std::hash<KeyView>()(key);
+            UsageList& list = segment_list_(segment);
+            list.emplace_back(std::move(key), std::move(value), weight, hash);
+            auto entry = --list.end();
+            entry->segment = segment;
+            if (!hashtable_.emplace(entry->key, entry).second) {
+                list.pop_back();
+                return false;
+            }
+            segment_weight_(segment) += weight;
+            weight_ += weight;
+            if (record.ttl) {
+                if (!now) {
+                    now = now_();
+                    wheel_.Advance(now, [](TimerNode*) {});
+                }
+                wheel_.Schedule(&*entry, now + record.ttl);
+                entry->ttl = record.ttl;
+            }
+        }
+        if (weight_ > peak_weight_) {
+            peak_weight_ = weight_;
+        }
+        if (admission_ == Admission::kTinyLfu) {
+            sketch_.EnsureCapacity(hashtable_.size());
+        }
+        while (protected_weight_ > protected_max_) {
+            move_(--protected_.end(), kProbation);
+        }
+        evict_();
+        return data == end;
+    }
+
+    void clear_() {
+        wheel_ = TimerWheel();
+        hashtable_.clear();
+        window_.clear();
+        probation_.clear();
+        protected_.clear();
+        weight_ = window_weight_ = probation_weight_ = protected_weight_ = 0;
+    }
+
+    void expire_(uint64_t now) {
+        wheel_.Advance(now, [this](TimerNode* node) {
+            erase_(hashtable_.find(static_cast<Entry*>(node)->key)->second);
+        });
+    }
+
+    // Looks the key up, dropping it if expired, and marks it as used.
+    // Returns window_.end() on a miss.
+    typename UsageList::iterator find_(const KeyView& key) {
+        record_(key);
+        auto it = hashtable_.find(key);
+        if (it == hashtable_.end()) {
+            return window_.end();
+        }
+        if (it->second->scheduled && it->second->deadline <= now_()) {
+            erase_(it->second);
+            return window_.end();
+        }
+        touch_(it->second);
+        return it->second;
+    }
+
+    // Zero weights count as 1, or such entries would never be evicted.
+    size_t weigh_(const Key& key, const Value& value) const {
+        return weigher_ ? std::max<size_t>(1, weigher_(key, value)) : 1;
+    }
+
+    // Heavier entries fit in neither the window nor the main segments.
+    size_t max_entry_weight_() const {
+        return std::max(window_max_, main_max_);
+    }
+
+    // Feeds the access into the frequency sketch; misses count too.
+    size_t record_(const KeyView& key) {
+        if (admission_ == Admission::kNone) {
+            return 0;
+        }
+        size_t hash = std::hash<KeyView>()(key);
+        sketch_.Increment(hash);
+        return hash;
+    }
+
+    UsageList& segment_list_(Segment segment) {
+        switch (segment) {
+            case kWindow: return window_;
+            case kProbation: return probation_;
+            default: return protected_;
+        }
+    }
+
+    size_t& segment_weight_(Segment segment) {
+        switch (segment) {
+            case kWindow: return window_weight_;
+            case kProbation: return probation_weight_;
+            default: return protected_weight_;
+        }
+    }
+
+    void move_(typename UsageList::iterator it, Segment segment) {
+        segment_weight_(it->segment) -= it->weight;
+        segment_weight_(segment) += it->weight;
+        segment_list_(segment).splice(segment_list_(segment).begin(),
+                                      segment_list_(it->segment), it);
+        it->segment = segment;
+    }
+
+    void touch_(typename UsageList::iterator it) {
+        if (it->segment != kProbation) {
+            move_(it, it->segment);
+            return;
+        }
+        move_(it, kProtected);
+        while (protected_weight_ > protected_max_) {
+            move_(--protected_.end(), kProbation);
+        }
+    }
+
+    void erase_(typename UsageList::iterator it) {
+        wheel_.Cancel(&*it);
+        segment_weight_(it->segment) -= it->weight;
+        weight_ -= it->weight;
+        hashtable_.erase(it->key);
+        segment_list_(it->segment).erase(it);
+    }
+
+    // The main cache's next victim: probation LRU, then protected LRU.
+    typename UsageList::iterator victim_() {
+        return probation_.empty() ? --protected_.end() : --probation_.end();
+    }
+
+    void evict_() {
+        while (window_weight_ > window_max_) {
+            auto candidate = --window_.end();
+            if (candidate->weight > main_max_) {
+                erase_(candidate);
+                continue;
+            }
+            bool admitted = true;
+            while (probation_weight_ + protected_weight_ + candidate->weight > main_max_) {
+                auto victim = victim_();
+                if (sketch_.Frequency(candidate->hash) > sketch_.Frequency(victim->hash)) {
+                    erase_(victim);
+                } else {
+                    admitted = false;
+                    break;
+                }
+            }
+            if (admitted) {
+                move_(candidate, kProbation);
+            } else {
+                erase_(candidate);
+            }
+        }
+        // Entries updated in place may have outgrown the main segments.
+        while (probation_weight_ + protected_weight_ > main_max_) {
+            erase_(victim_());
+        }
+    }
 };
+
+typedef BasicLruCache<std::string, std::string> LruCache;
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <limits>
+#include <functional>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+
+#include "lru_cache.h"
+
+// Thread-safe LruCache: keys are hashed across independently locked shards,
+// so threads touching different shards never wait for each other.
+// Recency is tracked per shard, so eviction is only approximately LRU.
+template <class Key, class Value>
+class BasicShardedLruCache {
+public:
+    typedef BasicLruCache<Key, Value> Cache;
+    typedef typename Cache::KeyView KeyView;
+
+    // Fetches the value for a key from the backing store.
+    typedef std::function<Value(const Key& key)> Loader;
+
+    static constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+    static constexpr size_t kDefaultShardCount = 16;
+    // Refreshes waiting for the background worker beyond this many are
+    // skipped; their entries are loaded again on the miss after expiry.
+    static constexpr size_t kMaxQueuedRefreshes = 64;
+
+    // max_size bounds the whole cache and is split evenly between shards;
+    // there are never more shards than max_size.
+    explicit BasicShardedLruCache(size_t max_size = kUnbounded,
+                                  size_t shard_count = kDefaultShardCount) {
+        init_(max_size, nullptr, shard_count, Cache::Admission::kNone);
+    }
+
+    // Weighted or admission-filtered shards,
+    // see LruCache(max_weight, weigher, admission).
+    BasicShardedLruCache(size_t max_weight, typename Cache::Weigher weigher,
+                         size_t shard_count = kDefaultShardCount,
+                         typename Cache::Admission admission = Cache::Admission::kNone) {
+        init_(max_weight, std::move(weigher), shard_count, admission);
+    }
+
+    void Set(Key key, Value value) {
+        Shard& shard = shard_(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.cache.Set(std::move(key), std::move(value));
+    }
+
+    void Set(Key key, Value value, typename Cache::Duration ttl) {
+        Shard& shard = shard_(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.cache.Set(std::move(key), std::move(value), ttl);
+    }
+
+    bool Get(const KeyView& key, Value* value) {
+        Shard& shard = shard_(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.cache.Get(key, value);
+    }
+
+    // The visitor runs under the shard's lock.
+    template <class Visitor,
+              class = typename std::enable_if<
+                  !std::is_pointer<typename std::decay<Visitor>::type>::value>::type>
+    bool Get(const KeyView& key, Visitor&& visitor) {
+        Shard& shard = shard_(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.cache.Get(key, std::forward<Visitor>(visitor));
+    }
+
+    // Read-through lookup: on a miss calls loader(key), caches the result
+    // with the default TTL and returns it. Concurrent misses on one key
+    // share a single call; the others wait for it and get the same value
+    // or exception.
+    // With SetRefreshAhead, a hit on an entry close to expiry returns the
+    // cached value and has a background worker reload it, keeping the TTL
+    // the entry was set with. A miss never waits for a queued refresh: it
+    // loads the key itself.
+    Value GetOrLoad(const KeyView& key, const Loader& loader) {
+        return get_or_load_(key, loader, nullptr);
+    }
+
+    // As above, caching a loaded value for `ttl`.
+    Value GetOrLoad(const KeyView& key, const Loader& loader, typename Cache::Duration ttl) {
+        return get_or_load_(key, loader, &ttl);
+    }
+
+    // GetOrLoad hits with less than `before_expiry` of TTL left trigger an
+    // asynchronous reload. Zero (the default) disables refreshing.
+    void SetRefreshAhead(typename Cache::Duration before_expiry) {
+        refresh_ahead_.store(before_expiry.count(), std::memory_order_relaxed);
+    }
+
+    void SetDefaultTtl(typename Cache::Duration ttl) {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->cache.SetDefaultTtl(ttl);
+        }
+    }
+
+    // The clock is shared by all shards and must be thread-safe.
+    void SetClock(const typename Cache::Clock& clock) {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->cache.SetClock(clock);
+        }
+    }
+
+    void Expire() {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->cache.Expire();
+        }
+    }
+
+    size_t Size() const {
+        size_t size = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            size += shard->cache.Size();
+        }
+        return size;
+    }
+
+    size_t Weight() const {
+        size_t weight = 0;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            weight += shard->cache.Weight();
+        }
+        return weight;
+    }
+
+    size_t ShardCount() const {
+        return shards_.size();
+    }
+
+    // Runs the queued refreshes, which hold pointers into the cache, and
+    // stops the worker.
+    ~BasicShardedLruCache() {
+        {
+            std::lock_guard<std::mutex> lock(refresh_mutex_);
+            stopping_ = true;
+        }
+        refresh_ready_.notify_one();
+        if (refresh_worker_.joinable()) {
+            refresh_worker_.join();
+        }
+    }
+
+private:
+    // Each shard sits on its own cache lines so that locking one
+    // does not invalidate its neighbours.
+    struct alignas(64) Shard {
+        Shard(size_t max_weight, const typename Cache::Weigher& weigher,
+              typename Cache::Admission admission)
+            : cache(max_weight, weigher, admission) {}
+
+        mutable std::mutex mutex;
+        Cache cache;
+        // Loads in progress, shared by every caller missing the same key.
+        std::unordered_map<Key, std::shared_future<Value>> loading;
+        // Keys queued for or being refreshed, so each is queued once.
+        std::unordered_set<Key> refreshing;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // Read by every GetOrLoad, so kept in ticks of Duration.
+    std::atomic<typename Cache::Duration::rep> refresh_ahead_{0};
+
+    // A reload listed in its shard's `refreshing`, waiting for the worker.
+    struct Refresh {
+        Shard* shard;
+        Key key;
+        Loader loader;
+        typename Cache::Duration ttl;
+    };
+
+    // One worker, started on the first refresh, runs them all in order.
+    std::mutex refresh_mutex_;
+    std::condition_variable refresh_ready_;
+    std::deque<Refresh> refreshes_;
+    std::thread refresh_worker_;
+    bool stopping_ = false;
+
+    Value get_or_load_(const KeyView& key, const Loader& loader,
+                       const typename Cache::Duration* ttl) {
+        Shard& shard = shard_(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        Value value;
+        typename Cache::Duration time_left, entry_ttl;
+        typename Cache::Duration refresh_ahead(refresh_ahead_.load(std::memory_order_relaxed));
+        if (shard.cache.Get(key, &value, &time_left, &entry_ttl)) {
+            if (time_left < refresh_ahead && queue_refresh_(&shard, Key(key), loader, entry_ttl)) {
+                lock.unlock();
+                start_refresh_();
+            }
+            return value;
+        }
+
+        Key owned_key(key);
+        auto flight = shard.loading.find(owned_key);
+        if (flight != shard.loading.end()) {
+            std::shared_future<Value> loaded = flight->second;
+            lock.unlock();
+            return loaded.get();
+        }
+        std::promise<Value> promise;
+        shard.loading.emplace(owned_key, promise.get_future().share());
+        lock.unlock();
+
+        try {
+            value = loader(owned_key);
+        } catch (...) {
+            lock.lock();
+            shard.loading.erase(owned_key);
+            lock.unlock();
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+        lock.lock();
+        shard.cache.Set(owned_key, value, ttl ? *ttl : shard.cache.DefaultTtl());
+        shard.loading.erase(owned_key);
+        lock.unlock();
+        promise.set_value(value);
+        return value;
+    }
+
+    // Called with the shard locked: queues the reload unless the key is
+    // already loading or refreshing, or the queue is full. Misses do not
+    // wait for it, so a long queue never delays them.
+    bool queue_refresh_(Shard* shard, Key key, const Loader& loader,
+                        typename Cache::Duration ttl) {
+        if (shard->loading.count(key) || shard->refreshing.count(key)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(refresh_mutex_);
+        if (refreshes_.size() >= kMaxQueuedRefreshes) {
+            return false;
+        }
+        refreshes_.push_back(Refresh{shard, key, loader, ttl});
+        shard->refreshing.insert(std::move(key));
+        return true;
+    }
+
+    // Called after the shard is unlocked.
+    void start_refresh_() {
+        {
+            std::lock_guard<std::mutex> lock(refresh_mutex_);
+            if (!refresh_worker_.joinable()) {
+                refresh_worker_ = std::thread([this] { refresh_loop_(); });
+            }
+        }
+        refresh_ready_.notify_one();
+    }
+
+    // A failed reload keeps the old value.
+    void refresh_loop_() {
+        std::unique_lock<std::mutex> lock(refresh_mutex_);
+        while (true) {
+            refresh_ready_.wait(lock, [this] { return stopping_ || !refreshes_.empty(); });
+            if (refreshes_.empty()) {
+                return;
+            }
+            Refresh refresh = std::move(refreshes_.front());
+            refreshes_.pop_front();
+            lock.unlock();
+
+            Shard* shard = refresh.shard;
+            try {
+                Value value = refresh.loader(refresh.key);
+                std::lock_guard<std::mutex> shard_lock(shard->mutex);
+                shard->cache.Set(refresh.key, std::move(value), refresh.ttl);
+                shard->refreshing.erase(refresh.key);
+            } catch (...) {
+                std::lock_guard<std::mutex> shard_lock(shard->mutex);
+                shard->refreshing.erase(refresh.key);
+            }
+            lock.lock();
+        }
+    }
+
+    void init_(size_t max_weight, typename Cache::Weigher weigher, size_t shard_count,
+               typename Cache::Admission admission) {
+        // Every shard gets at least one unit of the budget, and the shards'
+        // budgets add up to exactly max_weight.
+        shard_count = std::max<size_t>(1, std::min(shard_count, max_weight));
+        shards_.reserve(shard_count);
+        for (size_t i = 0; i < shard_count; ++i) {
+            size_t shard_weight = kUnbounded;
+            if (max_weight != kUnbounded) {
+                shard_weight = max_weight / shard_count + (i < max_weight % shard_count);
+            }
+            shards_.emplace_back(new Shard(shard_weight, weigher, admission));
+        }
+    }
+
+    Shard& shard_(const KeyView& key) {
+        // The shard's own hash table reuses std::hash, so pick the shard
+        // from remixed bits to keep its buckets evenly filled.
+        uint64_t hash = std::hash<KeyView>()(key) * 0x9E3779B97F4A7C15ull;
+        return *shards_[(hash >> 32) % shards_.size()];
+    }
+};
+
+typedef BasicShardedLruCache<std::string, std::string> ShardedLruCache;
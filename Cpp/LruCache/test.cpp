@@ -1,7 +1,19 @@
 #include <iostream>
 #include <cassert>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <string_view>
+#include <chrono>
+#include <stdexcept>
+#include <future>
 
 #include "lru_cache.h"
+#include "sharded_lru_cache.h"
 
 #define ASSERT_EQ(expected, actual) { \
     auto __expected = expected; \
@@ -14,6 +26,77 @@
     } \
 }
 
+// Every replaceable allocation function goes through Allocate and
+// Deallocate, so that the counts cover them all and each delete matches
+// its new.
+std::atomic<size_t> allocations(0);
+
+void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+    ++allocations;
+    void* ptr = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        ptr = malloc(size ? size : 1);
+    } else if (posix_memalign(&ptr, alignment, size ? size : 1) != 0) {
+        ptr = nullptr;
+    }
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void Deallocate(void* ptr) noexcept {
+    free(ptr);
+}
+
+void* operator new(size_t size) {
+    return Allocate(size);
+}
+
+void* operator new[](size_t size) {
+    return Allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* ptr) noexcept {
+    Deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    Deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    Deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    Deallocate(ptr);
+}
+
 void TestSetGet() {
     LruCache cache(10);
 
@@ -65,6 +148,367 @@ void TestEviction() {
     ASSERT_EQ(true, cache.Get("f", &value));
 }
 
+void TestReadHeavy() {
+    LruCache cache(3);
+    std::string value;
+
+    cache.Set("a", "1");
+    cache.Set("b", "2");
+    for (int i = 0; i < 1000; ++i) {
+        cache.Get("a", &value);
+        cache.Get("b", &value);
+        cache.Set("a", std::to_string(i));
+    }
+    ASSERT_EQ(2u, cache.Size());
+    ASSERT_EQ(true, cache.Get("a", &value));
+    ASSERT_EQ("999", value);
+
+    cache.Set("c", "3");
+    cache.Set("d", "4");
+    ASSERT_EQ(3u, cache.Size());
+    ASSERT_EQ(false, cache.Get("b", &value));
+}
+
+void TestByteBudget() {
+    LruCache cache = LruCache::WithByteBudget(10);
+    std::string value;
+
+    cache.Set("a", "1234");
+    cache.Set("b", "1234");
+    ASSERT_EQ(10u, cache.Weight());
+    ASSERT_EQ(2u, cache.Size());
+
+    cache.Set("c", "12");
+    ASSERT_EQ(false, cache.Get("a", &value));
+    ASSERT_EQ(8u, cache.Weight());
+
+    cache.Set("b", "1");
+    ASSERT_EQ(5u, cache.Weight());
+    cache.Set("d", "1234");
+    ASSERT_EQ(true, cache.Get("b", &value));
+    ASSERT_EQ(true, cache.Get("c", &value));
+    ASSERT_EQ(true, cache.Get("d", &value));
+    ASSERT_EQ(10u, cache.Weight());
+
+    // Too heavy to cache at all: the other entries stay.
+    cache.Set("e", std::string(100, 'x'));
+    ASSERT_EQ(false, cache.Get("e", &value));
+    ASSERT_EQ(3u, cache.Size());
+    ASSERT_EQ(10u, cache.Weight());
+    ASSERT_EQ(true, cache.Get("b", &value));
+    ASSERT_EQ(true, cache.Get("c", &value));
+    ASSERT_EQ(true, cache.Get("d", &value));
+
+    // Overwriting a key with one only drops that key.
+    cache.Set("c", std::string(100, 'x'));
+    ASSERT_EQ(false, cache.Get("c", &value));
+    ASSERT_EQ(2u, cache.Size());
+    ASSERT_EQ(7u, cache.Weight());
+    ASSERT_EQ(13u, cache.PeakWeight());
+}
+
+// Entries that weigh nothing still take a unit of the budget.
+void TestZeroWeight() {
+    for (auto admission : {LruCache::Admission::kNone, LruCache::Admission::kTinyLfu}) {
+        LruCache cache(100, [](const std::string&, const std::string&) {
+            return size_t(0);
+        }, admission);
+        for (int i = 0; i < 1000; ++i) {
+            cache.Set(std::to_string(i), "");
+        }
+        bool bounded = cache.Size() <= 100;
+        ASSERT_EQ(true, bounded);
+        ASSERT_EQ(cache.Size(), cache.Weight());
+    }
+}
+
+void TestCustomWeigher() {
+    LruCache cache(100, [](const std::string&, const std::string& value) {
+        return value.size() * 10;
+    });
+    std::string value;
+
+    cache.Set("a", "12345");
+    cache.Set("b", "1234");
+    cache.Set("c", "12");
+    ASSERT_EQ(false, cache.Get("a", &value));
+    ASSERT_EQ(60u, cache.Weight());
+    ASSERT_EQ(110u, cache.PeakWeight());
+}
+
+void TestTinyLfuSetGet() {
+    LruCache cache(3, nullptr, LruCache::Admission::kTinyLfu);
+    std::string value;
+
+    cache.Set("a", "1");
+    cache.Set("b", "2");
+    cache.Set("c", "3");
+    ASSERT_EQ(true, cache.Get("a", &value));
+    ASSERT_EQ("1", value);
+    ASSERT_EQ(true, cache.Get("c", &value));
+    ASSERT_EQ("3", value);
+
+    cache.Set("a", "4");
+    ASSERT_EQ(true, cache.Get("a", &value));
+    ASSERT_EQ("4", value);
+
+    for (int i = 0; i < 100; ++i) {
+        cache.Set(std::to_string(i), "x");
+    }
+    ASSERT_EQ(3u, cache.Size());
+    ASSERT_EQ(true, cache.Get("a", &value));
+}
+
+void TestTinyLfuScanResistance() {
+    LruCache lru(100);
+    LruCache tiny_lfu(100, nullptr, LruCache::Admission::kTinyLfu);
+    std::string value;
+
+    // 80 hot keys keep being read while a scan of cold keys passes through.
+    int lru_hits = 0;
+    int tiny_lfu_hits = 0;
+    for (int i = 0; i < 20000; ++i) {
+        std::string key = (i % 2 == 0) ? "hot" + std::to_string(i / 2 % 80)
+                                       : "scan" + std::to_string(i);
+        bool hit = lru.Get(key, &value);
+        if (!hit) {
+            lru.Set(key, key);
+        } else if (i >= 10000 && i % 2 == 0) {
+            ++lru_hits;
+        }
+        hit = tiny_lfu.Get(key, &value);
+        if (!hit) {
+            tiny_lfu.Set(key, key);
+        } else if (i >= 10000 && i % 2 == 0) {
+            ++tiny_lfu_hits;
+        }
+    }
+    ASSERT_EQ(0, lru_hits);
+    ASSERT_EQ(true, tiny_lfu_hits > 4900);
+    ASSERT_EQ(100u, tiny_lfu.Size());
+}
+
+void TestTtl() {
+    LruCache cache(10);
+    LruCache::TimePoint now;
+    cache.SetClock([&now] { return now; });
+    std::string value;
+
+    cache.Set("a", "1", std::chrono::seconds(1));
+    cache.Set("b", "2");
+    cache.Set("c", "3", std::chrono::seconds(3));
+
+    now += std::chrono::milliseconds(999);
+    ASSERT_EQ(true, cache.Get("a", &value));
+    now += std::chrono::milliseconds(1);
+    ASSERT_EQ(false, cache.Get("a", &value));
+    ASSERT_EQ(2u, cache.Size());
+
+    cache.Set("c", "4", std::chrono::seconds(3));
+    now += std::chrono::seconds(2);
+    ASSERT_EQ(true, cache.Get("c", &value));
+    ASSERT_EQ("4", value);
+
+    cache.Set("c", "5");
+    now += std::chrono::hours(1000);
+    ASSERT_EQ(true, cache.Get("b", &value));
+    ASSERT_EQ(true, cache.Get("c", &value));
+}
+
+void TestTtlProactiveExpiry() {
+    LruCache cache(100000);
+    LruCache::TimePoint now;
+    cache.SetClock([&now] { return now; });
+    cache.SetDefaultTtl(std::chrono::seconds(10));
+    std::string value;
+
+    for (int i = 0; i < 10000; ++i) {
+        cache.Set(std::to_string(i), "foo", std::chrono::milliseconds(1 + i * 7));
+    }
+    cache.Set("forever", "bar", LruCache::Duration::zero());
+
+    now += std::chrono::milliseconds(35000);
+    cache.Expire();
+    ASSERT_EQ(5000u + 1, cache.Size());
+    ASSERT_EQ(true, cache.Get("5000", &value));
+    ASSERT_EQ(false, cache.Get("4999", &value));
+
+    cache.Set("x", "1");
+    now += std::chrono::hours(24 * 365 * 10);
+    cache.Set("y", "2", std::chrono::hours(24 * 365 * 10));
+    ASSERT_EQ(2u, cache.Size());
+
+    now += std::chrono::hours(24 * 365 * 10);
+    cache.Expire();
+    ASSERT_EQ(1u, cache.Size());
+    ASSERT_EQ(true, cache.Get("forever", &value));
+}
+
+void TestMove() {
+    LruCache cache(10, nullptr, LruCache::Admission::kTinyLfu);
+    LruCache::TimePoint now;
+    cache.SetClock([&now] { return now; });
+    std::string value;
+    cache.Set("a", "1", std::chrono::seconds(1));
+    cache.Set("b", "2");
+
+    LruCache moved(std::move(cache));
+    ASSERT_EQ(0u, cache.Size());
+    ASSERT_EQ(false, cache.Get("a", &value));
+    cache.Set("c", "3", std::chrono::seconds(2));
+    now += std::chrono::seconds(1);
+    cache.Expire();
+    ASSERT_EQ(1u, cache.Size());
+    ASSERT_EQ(true, cache.Get("c", &value));
+
+    ASSERT_EQ(2u, moved.Size());
+    moved.Expire();
+    ASSERT_EQ(1u, moved.Size());
+    ASSERT_EQ(true, moved.Get("b", &value));
+
+    cache = std::move(moved);
+    ASSERT_EQ(true, cache.Get("b", &value));
+    ASSERT_EQ(false, cache.Get("c", &value));
+    ASSERT_EQ(0u, moved.Size());
+    now += std::chrono::seconds(1);
+    moved.Set("d", "4", std::chrono::seconds(1));
+    ASSERT_EQ(true, moved.Get("d", &value));
+}
+
+void TestSnapshot() {
+    const std::string path = "lru_cache_snapshot.bin";
+    LruCache::TimePoint now;
+    std::string value;
+
+    LruCache cache(4);
+    cache.SetClock([&now] { return now; });
+    cache.Set("a", "1");
+    cache.Set("b", std::string(1000, 'b'));
+    cache.Set("c", "3", std::chrono::seconds(10));
+    cache.Set("d", "", std::chrono::seconds(1));
+    cache.Get("a", &value);
+    now += std::chrono::seconds(5);
+    ASSERT_EQ(true, cache.Dump(path));
+
+    LruCache restored(4);
+    restored.SetClock([&now] { return now; });
+    ASSERT_EQ(true, restored.Restore(path));
+    ASSERT_EQ(3u, restored.Size());
+    ASSERT_EQ(false, restored.Restore(path));
+
+    // recency order survives: b is the least recently used
+    restored.Set("e", "5");
+    restored.Set("f", "6");
+    ASSERT_EQ(false, restored.Get("b", &value));
+    ASSERT_EQ(true, restored.Get("a", &value));
+    ASSERT_EQ("1", value);
+    ASSERT_EQ(true, restored.Get("c", &value));
+    ASSERT_EQ("3", value);
+
+    now += std::chrono::seconds(5);
+    ASSERT_EQ(false, restored.Get("c", &value));
+
+    LruCache smaller(1);
+    ASSERT_EQ(true, smaller.Restore(path));
+    ASSERT_EQ(1u, smaller.Size());
+    ASSERT_EQ(true, smaller.Get("a", &value));
+
+    std::remove(path.c_str());
+    LruCache missing(4);
+    ASSERT_EQ(false, missing.Restore(path));
+}
+
+void TestSnapshotDamaged() {
+    const std::string path = "lru_cache_snapshot.bin";
+    LruCache cache(100);
+    for (int i = 0; i < 100; ++i) {
+        cache.Set(std::to_string(i), std::to_string(i));
+    }
+    ASSERT_EQ(true, cache.Dump(path));
+
+    ASSERT_EQ(0, truncate(path.c_str(), 500));
+    LruCache restored(100);
+    ASSERT_EQ(false, restored.Restore(path));
+    ASSERT_EQ(0u, restored.Size());
+    ASSERT_EQ(0u, restored.Weight());
+
+    restored.Set("a", "1");
+    std::string value;
+    ASSERT_EQ(true, restored.Get("a", &value));
+
+    // sizes whose sum wraps around must not pass the bounds check
+    ASSERT_EQ(true, cache.Dump(path));
+    FILE* file = fopen(path.c_str(), "r+b");
+    uint64_t sizes[2] = {1, UINT64_MAX};
+    fseek(file, 24, SEEK_SET);
+    ASSERT_EQ(2u, fwrite(sizes, sizeof(sizes[0]), 2, file));
+    fclose(file);
+    LruCache wrapped(100);
+    ASSERT_EQ(false, wrapped.Restore(path));
+    ASSERT_EQ(0u, wrapped.Size());
+    std::remove(path.c_str());
+}
+
+void TestStringViewGet() {
+    LruCache cache(10);
+    std::string long_key(100, 'k');
+    cache.Set(long_key, std::string(1000, 'v'));
+    cache.Set("a", "1");
+
+    std::string_view key_view(long_key);
+    size_t value_size = 0;
+    size_t before = allocations;
+    ASSERT_EQ(true, cache.Get(key_view, [&](const std::string& value) {
+        value_size = value.size();
+    }));
+    ASSERT_EQ(false, cache.Get(std::string_view("missing"), [](const std::string&) {}));
+    ASSERT_EQ(before, allocations.load());
+    ASSERT_EQ(1000u, value_size);
+
+    std::string value;
+    ASSERT_EQ(true, cache.Get("a", &value));
+    ASSERT_EQ("1", value);
+}
+
+struct Point {
+    int x;
+    int y;
+};
+
+void TestTemplateTypes() {
+    BasicLruCache<int64_t, Point> points(2);
+    Point point;
+    points.Set(1, {1, 2});
+    points.Set(2, {3, 4});
+    points.Set(3, {5, 6});
+    ASSERT_EQ(false, points.Get(1, &point));
+    ASSERT_EQ(true, points.Get(3, &point));
+    ASSERT_EQ(6, point.y);
+
+    const std::string path = "lru_cache_snapshot.bin";
+    ASSERT_EQ(true, points.Dump(path));
+    BasicLruCache<int64_t, Point> restored(2);
+    ASSERT_EQ(true, restored.Restore(path));
+    ASSERT_EQ(true, restored.Get(2, &point));
+    ASSERT_EQ(3, point.x);
+    std::remove(path.c_str());
+
+    BasicLruCache<std::string, std::unique_ptr<std::string>> owned(2);
+    std::unique_ptr<std::string> big(new std::string(1 << 20, 'x'));
+    const char* data = big->data();
+    owned.Set("big", std::move(big));
+    bool same_buffer = false;
+    ASSERT_EQ(true, owned.Get("big", [&](const std::unique_ptr<std::string>& value) {
+        same_buffer = value->data() == data;
+    }));
+    ASSERT_EQ(true, same_buffer);
+
+    BasicShardedLruCache<int, std::string> sharded(100, 4);
+    sharded.Set(7, "seven");
+    std::string value;
+    ASSERT_EQ(true, sharded.Get(7, &value));
+    ASSERT_EQ("seven", value);
+}
 
 void TestStress() {
     LruCache cache(100);
@@ -80,9 +524,274 @@ void TestStress() {
     }
 }
 
+void TestTinyLfuStress() {
+    LruCache cache(100, nullptr, LruCache::Admission::kTinyLfu);
+    std::string value;
+
+    srand(42);
+    for (size_t i = 0; i < 100000; ++i) {
+        std::string key = std::to_string(rand() % 500);
+        if (rand() % 2 == 0) {
+            cache.Set(key, "foo");
+        } else {
+            cache.Get(key, &value);
+        }
+    }
+    ASSERT_EQ(100u, cache.Size());
+}
+
+// Growing the sketch must not forget what it has counted so far.
+void TestFrequencySketchGrowth() {
+    FrequencySketch sketch(16);
+    for (uint64_t key = 0; key < 16; ++key) {
+        for (uint64_t i = 0; i < key; ++i) {
+            sketch.Increment(key * 0x9E3779B97F4A7C15ull);
+        }
+    }
+    std::vector<int> before;
+    for (uint64_t key = 0; key < 16; ++key) {
+        before.push_back(sketch.Frequency(key * 0x9E3779B97F4A7C15ull));
+    }
+    sketch.EnsureCapacity(1 << 12);
+    for (uint64_t key = 0; key < 16; ++key) {
+        ASSERT_EQ(before[key], sketch.Frequency(key * 0x9E3779B97F4A7C15ull));
+    }
+    int hottest = sketch.Frequency(15 * 0x9E3779B97F4A7C15ull);
+    bool counted = hottest >= 15;
+    ASSERT_EQ(true, counted);
+}
+
+void TestShardedSetGet() {
+    ShardedLruCache cache(100, 4);
+    std::string value;
+
+    cache.Set("a", "1");
+    cache.Set("b", "2");
+    ASSERT_EQ(true, cache.Get("a", &value));
+    ASSERT_EQ("1", value);
+    ASSERT_EQ(true, cache.Get("b", &value));
+    ASSERT_EQ("2", value);
+    ASSERT_EQ(false, cache.Get("c", &value));
+
+    cache.Set("a", "3");
+    ASSERT_EQ(true, cache.Get("a", &value));
+    ASSERT_EQ("3", value);
+    ASSERT_EQ(2u, cache.Size());
+}
+
+void TestShardedCapacity() {
+    ShardedLruCache cache(64, 8);
+    for (int i = 0; i < 10000; ++i) {
+        cache.Set(std::to_string(i), "foo");
+    }
+    ASSERT_EQ(true, cache.Size() <= 64);
+
+    ShardedLruCache unbounded;
+    for (int i = 0; i < 10000; ++i) {
+        unbounded.Set(std::to_string(i), "foo");
+    }
+    ASSERT_EQ(10000u, unbounded.Size());
+
+    ShardedLruCache budgeted(1000, LruCache::KeyValueBytes, 4);
+    for (int i = 0; i < 10000; ++i) {
+        budgeted.Set(std::to_string(i), "foo");
+    }
+    ASSERT_EQ(true, budgeted.Weight() <= 1000);
+
+    // Capacities that do not divide evenly, or are below the shard count:
+    // once every shard is full the cache holds exactly its capacity.
+    for (size_t capacity : {1, 4, 15, 37}) {
+        ShardedLruCache small(capacity, 16);
+        bool capped = small.ShardCount() <= capacity;
+        ASSERT_EQ(true, capped);
+        for (int i = 0; i < 10000; ++i) {
+            small.Set(std::to_string(i), "foo");
+        }
+        ASSERT_EQ(capacity, small.Size());
+    }
+}
+
+void TestShardedConcurrent() {
+    ShardedLruCache cache(1000, 8);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&cache, t] {
+            std::string value;
+            for (int i = 0; i < 20000; ++i) {
+                std::string key = std::to_string((i * 7 + t) % 2000);
+                if (i % 3 == 0) {
+                    cache.Set(key, key);
+                } else if (cache.Get(key, &value) && value != key) {
+                    std::cerr << "wrong value for " << key << std::endl;
+                    std::terminate();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(true, cache.Size() <= 1000);
+}
+
+void TestGetOrLoadSingleFlight() {
+    ShardedLruCache cache(100, 4);
+    std::atomic<int> loads(0);
+    auto loader = [&loads](const std::string& key) {
+        ++loads;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return "loaded " + key;
+    };
+
+    std::vector<std::thread> threads;
+    std::atomic<int> correct(0);
+    for (int t = 0; t < 16; ++t) {
+        threads.emplace_back([&] {
+            correct += cache.GetOrLoad("a", loader) == "loaded a";
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(1, loads.load());
+    ASSERT_EQ(16, correct.load());
+
+    ASSERT_EQ("loaded a", cache.GetOrLoad("a", loader));
+    ASSERT_EQ(1, loads.load());
+
+    bool thrown = false;
+    try {
+        cache.GetOrLoad("b", [](const std::string&) -> std::string {
+            throw std::runtime_error("backend down");
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    ASSERT_EQ(true, thrown);
+    ASSERT_EQ("loaded b", cache.GetOrLoad("b", loader));
+}
+
+void TestGetOrLoadRefreshAhead() {
+    ShardedLruCache cache(100, 4);
+    std::atomic<int64_t> now_ms(0);
+    cache.SetClock([&now_ms] {
+        return LruCache::TimePoint(std::chrono::milliseconds(now_ms.load()));
+    });
+    cache.SetDefaultTtl(std::chrono::seconds(10));
+    cache.SetRefreshAhead(std::chrono::seconds(2));
+
+    std::atomic<int> loads(0);
+    auto loader = [&loads](const std::string&) {
+        return std::to_string(++loads);
+    };
+
+    ASSERT_EQ("1", cache.GetOrLoad("a", loader));
+    now_ms = 5000;
+    ASSERT_EQ("1", cache.GetOrLoad("a", loader));
+    ASSERT_EQ(1, loads.load());
+
+    now_ms = 9000;
+    ASSERT_EQ("1", cache.GetOrLoad("a", loader));
+    std::string value;
+    for (int i = 0; i < 1000 && value != "2"; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        cache.Get("a", &value);
+    }
+    ASSERT_EQ("2", value);
+
+    now_ms = 15000;
+    ASSERT_EQ("2", cache.GetOrLoad("a", loader));
+    ASSERT_EQ(2, loads.load());
+}
+
+void TestGetOrLoadRefreshKeepsTtl() {
+    ShardedLruCache cache(100, 4);
+    std::atomic<int64_t> now_ms(0);
+    cache.SetClock([&now_ms] {
+        return LruCache::TimePoint(std::chrono::milliseconds(now_ms.load()));
+    });
+    cache.SetRefreshAhead(std::chrono::seconds(2));
+
+    std::atomic<int> loads(0);
+    auto loader = [&loads](const std::string&) {
+        return std::to_string(++loads);
+    };
+
+    // no default TTL: the refresh must keep the 10 s the entry was set with
+    cache.Set("a", "0", std::chrono::seconds(10));
+    ASSERT_EQ("1", cache.GetOrLoad("b", loader, std::chrono::seconds(10)));
+    now_ms = 9000;
+    ASSERT_EQ("0", cache.GetOrLoad("a", loader));
+    ASSERT_EQ("1", cache.GetOrLoad("b", loader));
+    std::string a, b;
+    for (int i = 0; i < 1000 && (a == "0" || b == "1" || a.empty() || b.empty()); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        cache.Get("a", &a);
+        cache.Get("b", &b);
+    }
+    ASSERT_EQ(3, loads.load());
+    ASSERT_EQ(true, a != "0" && b != "1");
+
+    now_ms = 18000;
+    ASSERT_EQ(true, cache.Get("a", &a));
+    now_ms = 19000;
+    ASSERT_EQ(false, cache.Get("a", &a));
+    ASSERT_EQ(false, cache.Get("b", &b));
+}
+
+// A miss on a key whose refresh is stuck in the worker loads it inline.
+void TestGetOrLoadMissSkipsRefresh() {
+    ShardedLruCache cache(100, 4);
+    std::atomic<int64_t> now_ms(0);
+    cache.SetClock([&now_ms] {
+        return LruCache::TimePoint(std::chrono::milliseconds(now_ms.load()));
+    });
+    cache.SetDefaultTtl(std::chrono::seconds(10));
+    cache.SetRefreshAhead(std::chrono::seconds(2));
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    auto blocked = [released](const std::string&) {
+        released.wait();
+        return std::string("refreshed");
+    };
+    auto loader = [](const std::string&) {
+        return std::string("loaded");
+    };
+
+    ASSERT_EQ("loaded", cache.GetOrLoad("a", loader));
+    now_ms = 9000;
+    ASSERT_EQ("loaded", cache.GetOrLoad("a", blocked));
+    now_ms = 20000;
+    ASSERT_EQ("loaded", cache.GetOrLoad("a", loader));
+    release.set_value();
+}
+
 int main() {
     TestSetGet();
     TestEviction();
+    TestReadHeavy();
+    TestByteBudget();
+    TestCustomWeigher();
+    TestZeroWeight();
+    TestTinyLfuSetGet();
+    TestTinyLfuScanResistance();
+    TestTtl();
+    TestTtlProactiveExpiry();
+    TestMove();
+    TestSnapshot();
+    TestSnapshotDamaged();
+    TestStringViewGet();
+    TestTemplateTypes();
     TestStress();
+    TestTinyLfuStress();
+    TestFrequencySketchGrowth();
+    TestShardedSetGet();
+    TestShardedCapacity();
+    TestShardedConcurrent();
+    TestGetOrLoadSingleFlight();
+    TestGetOrLoadRefreshAhead();
+    TestGetOrLoadRefreshKeepsTtl();
+    TestGetOrLoadMissSkipsRefresh();
     return 0;
 }
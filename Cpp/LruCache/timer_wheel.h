@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// A node that can sit in a TimerWheel. Classes embed it (by inheriting)
+// so that scheduling never allocates.
+struct TimerNode {
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    uint64_t deadline = 0;
+    uint8_t level = 0;
+    uint8_t slot = 0;
+    bool scheduled = false;
+};
+
+// Hierarchical timing wheel over integer ticks. Level L has 64 slots of
+// 64^L ticks each; a timer goes to the lowest level whose span covers its
+// deadline and is cascaded one level down when its slot comes up. Every
+// timer is therefore touched at most once per level, so Schedule, Cancel
+// and expiry are O(1) amortized. Per-level occupancy masks let Advance
+// jump straight to the next slot that has anything in it.
+class TimerWheel {
+public:
+    static const int kLevels = 6;
+    static const int kSlotBits = 6;
+    static const int kSlots = 1 << kSlotBits;
+
+    TimerWheel() {}
+
+    // The nodes are linked into the wheel, so copying would share them.
+    // Moving hands them over and leaves the source empty.
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    TimerWheel(TimerWheel&& other) {
+        take_(&other);
+    }
+
+    TimerWheel& operator=(TimerWheel&& other) {
+        if (this != &other) {
+            take_(&other);
+        }
+        return *this;
+    }
+
+    uint64_t Now() const {
+        return now_;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    // A deadline that is already due fires on the next Advance.
+    void Schedule(TimerNode* node, uint64_t deadline) {
+        if (node->scheduled) {
+            Cancel(node);
+        }
+        node->deadline = deadline;
+        insert_(node, now_ + 1);
+        ++size_;
+    }
+
+    void Cancel(TimerNode* node) {
+        if (!node->scheduled) {
+            return;
+        }
+        unlink_(node);
+        --size_;
+    }
+
+    // Moves the wheel to `now`, calling on_expire(node) for every timer
+    // with deadline <= now. The callback may Cancel or Schedule other
+    // timers; the expired node is already unlinked when it is called.
+    template <class OnExpire>
+    void Advance(uint64_t now, OnExpire on_expire) {
+        while (now_ < now) {
+            if (size_ == 0) {
+                now_ = now;
+                return;
+            }
+            uint64_t next = next_event_();
+            if (next > now) {
+                now_ = now;
+                return;
+            }
+            now_ = next;
+            for (int level = kLevels - 1; level > 0; --level) {
+                if ((now_ & ((uint64_t(1) << (level * kSlotBits)) - 1)) == 0) {
+                    cascade_(level, (now_ >> (level * kSlotBits)) & (kSlots - 1));
+                }
+            }
+            size_t slot = now_ & (kSlots - 1);
+            while (TimerNode* node = slots_[0][slot]) {
+                unlink_(node);
+                if (node->deadline > now_) {
+                    insert_(node, now_ + 1);
+                } else {
+                    --size_;
+                    on_expire(node);
+                }
+            }
+        }
+    }
+
+private:
+    TimerNode* slots_[kLevels][kSlots] = {};
+    uint64_t occupied_[kLevels] = {};
+    uint64_t now_ = 0;
+    size_t size_ = 0;
+
+    void take_(TimerWheel* other) {
+        std::copy(&other->slots_[0][0], &other->slots_[0][0] + kLevels * kSlots, &slots_[0][0]);
+        std::copy(other->occupied_, other->occupied_ + kLevels, occupied_);
+        now_ = other->now_;
+        size_ = other->size_;
+        std::fill(&other->slots_[0][0], &other->slots_[0][0] + kLevels * kSlots, nullptr);
+        std::fill(other->occupied_, other->occupied_ + kLevels, 0);
+        other->size_ = 0;
+    }
+
+    // Files the node under max(deadline, earliest); earliest is never
+    // before now_.
+    void insert_(TimerNode* node, uint64_t earliest) {
+        uint64_t deadline = node->deadline > earliest ? node->deadline : earliest;
+        uint64_t delta = deadline - now_;
+        int level = 0;
+        while (level < kLevels - 1 && delta >= (uint64_t(1) << ((level + 1) * kSlotBits))) {
+            ++level;
+        }
+        if (level == kLevels - 1 && delta >= (uint64_t(1) << (kLevels * kSlotBits))) {
+            // Beyond the wheel's range: park in the furthest slot and
+            // reinsert from there.
+            deadline = now_ + (uint64_t(1) << (kLevels * kSlotBits)) - 1;
+        }
+        size_t slot = (deadline >> (level * kSlotBits)) & (kSlots - 1);
+
+        node->level = level;
+        node->slot = slot;
+        node->prev = nullptr;
+        node->next = slots_[level][slot];
+        if (node->next) {
+            node->next->prev = node;
+        }
+        slots_[level][slot] = node;
+        occupied_[level] |= uint64_t(1) << slot;
+        node->scheduled = true;
+    }
+
+    void unlink_(TimerNode* node) {
+        if (node->prev) {
+            node->prev->next = node->next;
+        } else {
+            slots_[node->level][node->slot] = node->next;
+            if (!node->next) {
+                occupied_[node->level] &= ~(uint64_t(1) << node->slot);
+            }
+        }
+        if (node->next) {
+            node->next->prev = node->prev;
+        }
+        node->prev = node->next = nullptr;
+        node->scheduled = false;
+    }
+
+    // Runs before slot now_ of level 0 is expired, so timers due right
+    // now may still land there.
+    void cascade_(int level, size_t slot) {
+        while (TimerNode* node = slots_[level][slot]) {
+            unlink_(node);
+            insert_(node, now_);
+        }
+    }
+
+    // The first tick after now_ at which some occupied slot comes up.
+    uint64_t next_event_() const {
+        uint64_t next = UINT64_MAX;
+        for (int level = 0; level < kLevels; ++level) {
+            if (!occupied_[level]) {
+                continue;
+            }
+            int shift = level * kSlotBits;
+            // First slot boundary of this level strictly after now_.
+            uint64_t boundary = (now_ >> shift) + 1;
+            int index = boundary & (kSlots - 1);
+            uint64_t rotated = (occupied_[level] >> index) |
+                               (index ? occupied_[level] << (kSlots - index) : 0);
+            uint64_t event = (boundary + __builtin_ctzll(rotated)) << shift;
+            if (event < next) {
+                next = event;
+            }
+        }
+        return next;
+    }
+};
@@ -0,0 +1,302 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "near_set.h"
+#include "concurrent_near_set.h"
+#include "near_set_nd.h"
+
+// NearSet as it was: a std::set.
+class SetNearSet {
+ public:
+    void Add(int64_t point) {
+        set_.insert(point);
+    }
+
+    void Remove(int64_t point) {
+        set_.erase(point);
+    }
+
+    std::vector<int64_t> FindNear(int64_t point, int64_t distance) const {
+        std::set<int64_t>::const_iterator it = set_.lower_bound(point - distance);
+        std::vector<int64_t> ans;
+        while (it != set_.end() && std::abs(*it - point) <= distance) {
+            ans.push_back(*it);
+            ++it;
+        }
+        return ans;
+    }
+
+ private:
+    std::set<int64_t> set_;
+};
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Adds `size` random points, queries them with windows holding about
+// `expected` points each, then replaces a tenth of them. Prints
+// operations per second for each phase.
+template <class Set>
+void Bench(const char* name, size_t size, int64_t expected) {
+    const size_t kQueries = 1000000;
+    const int64_t kRange = 1000 * 1000 * 1000;
+    std::mt19937_64 generator(42);
+    std::uniform_int_distribution<int64_t> pick(0, kRange);
+
+    Set set;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < size; ++i) {
+        set.Add(pick(generator));
+    }
+    double add = size / Seconds(start);
+
+    int64_t distance = kRange / static_cast<int64_t>(size) * expected / 2;
+    size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kQueries; ++i) {
+        found += set.FindNear(pick(generator), distance).size();
+    }
+    double find = kQueries / Seconds(start);
+
+    std::mt19937_64 replay(42);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < size / 10; ++i) {
+        set.Remove(pick(replay));
+        set.Add(pick(generator));
+    }
+    double update = size / 10 / Seconds(start);
+
+    std::cout << name << ", " << size << " points: add " << static_cast<size_t>(add)
+              << "/s, find near (" << found / kQueries << " found) "
+              << static_cast<size_t>(find) << "/s, remove + add "
+              << static_cast<size_t>(update) << "/s" << std::endl;
+}
+
+// The same sorted queries through FindNear, CountNear, ForEachNear and
+// FindNearBatch, with windows holding about `expected` points each.
+void BenchQueries(size_t size, int64_t expected) {
+    const size_t kQueries = 1000000;
+    const int64_t kRange = 1000 * 1000 * 1000;
+    std::mt19937_64 generator(42);
+    std::uniform_int_distribution<int64_t> pick(0, kRange);
+
+    NearSet set;
+    for (size_t i = 0; i < size; ++i) {
+        set.Add(pick(generator));
+    }
+    std::vector<int64_t> points(kQueries);
+    for (int64_t& point : points) {
+        point = pick(generator);
+    }
+    std::sort(points.begin(), points.end());
+    int64_t distance = kRange / static_cast<int64_t>(size) * expected / 2;
+
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t point : points) {
+        found += set.FindNear(point, distance).size();
+    }
+    double find = kQueries / Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int64_t point : points) {
+        found -= set.CountNear(point, distance);
+    }
+    double count = kQueries / Seconds(start);
+
+    int64_t sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (int64_t point : points) {
+        set.ForEachNear(point, distance, [&sum](int64_t x) {
+            sum += x;
+        });
+    }
+    double visit = kQueries / Seconds(start);
+
+    // In chunks, as a caller streaming its queries would, so that the
+    // output stays in cache and the vectors are reused.
+    const size_t kChunk = 1024;
+    std::vector<int64_t> chunk, batch;
+    std::vector<size_t> offsets;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kQueries; i += kChunk) {
+        chunk.assign(points.begin() + i, points.begin() + std::min(i + kChunk, kQueries));
+        set.FindNearBatch(chunk, distance, &batch, &offsets);
+        sum += batch.size();
+    }
+    double sweep = kQueries / Seconds(start);
+
+    if (found != 0 || sum == -1) {
+        std::cout << "counts disagree" << std::endl;
+    }
+    std::cout << "sorted queries, " << size << " points, ~" << expected
+              << " per window: find near " << static_cast<size_t>(find) << "/s, count "
+              << static_cast<size_t>(count) << "/s, for each " << static_cast<size_t>(visit)
+              << "/s, batch " << static_cast<size_t>(sweep) << "/s" << std::endl;
+}
+
+// Reads of a ConcurrentNearSet next to the same reads of a NearSet, and
+// the time Publish takes for batches of `batch` random changes.
+void BenchSnapshots(size_t size, size_t batch) {
+    const size_t kQueries = 1000000;
+    const size_t kBatches = 20;
+    const int64_t kRange = 1000 * 1000 * 1000;
+    std::mt19937_64 generator(42);
+    std::uniform_int_distribution<int64_t> pick(0, kRange);
+
+    NearSet set;
+    ConcurrentNearSet concurrent;
+    for (size_t i = 0; i < size; ++i) {
+        int64_t point = pick(generator);
+        set.Add(point);
+        concurrent.Add(point);
+    }
+    concurrent.Publish();
+    int64_t distance = kRange / static_cast<int64_t>(size) * 2;
+
+    size_t found = 0;
+    std::mt19937_64 replay(7);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kQueries; ++i) {
+        found += set.CountNear(pick(replay), distance);
+    }
+    double plain = kQueries / Seconds(start);
+
+    replay.seed(7);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kQueries; ++i) {
+        found -= concurrent.CountNear(pick(replay), distance);
+    }
+    double snapshot = kQueries / Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kBatches; ++i) {
+        for (size_t j = 0; j < batch; ++j) {
+            concurrent.Add(pick(generator));
+        }
+        concurrent.Publish();
+    }
+    double publish = Seconds(start) / kBatches * 1000;
+
+    if (found != 0) {
+        std::cout << "counts disagree" << std::endl;
+    }
+    std::cout << size << " points: count near " << static_cast<size_t>(plain)
+              << "/s, on a snapshot " << static_cast<size_t>(snapshot) << "/s; publishing "
+              << batch << " changes takes " << publish << " ms" << std::endl;
+}
+
+// 2-D points in a 1-D NearSet under the key x * 2^32 + y: a query scans
+// the strip of keys with x in range and filters on y.
+class StripNearSet2D {
+ public:
+    void Add(const NearSetND<2>::Point& point) {
+        set_.Add(point[0] << 32 | point[1]);
+    }
+
+    std::vector<NearSetND<2>::Point> FindNear(const NearSetND<2>::Point& point,
+                                              int64_t distance) const {
+        int64_t low = (point[0] - distance) << 32;
+        int64_t high = (point[0] + distance) << 32 | 0xffffffff;
+        std::vector<NearSetND<2>::Point> ans;
+        set_.ForEachNear(low + (high - low) / 2, (high - low + 1) / 2, [&](int64_t key) {
+            int64_t x = key >> 32;
+            int64_t y = key & 0xffffffff;
+            if (std::abs(x - point[0]) <= distance && std::abs(y - point[1]) <= distance) {
+                ans.push_back({x, y});
+            }
+        });
+        return ans;
+    }
+
+ private:
+    NearSet set_;
+};
+
+// Builds `size` random 2-D points both ways and runs the same cube
+// queries, which hold about `expected` points each.
+void BenchND(size_t size, double expected) {
+    const size_t kQueries = 200000;
+    const int64_t kRange = 1 << 30;
+    std::mt19937_64 generator(42);
+    std::uniform_int_distribution<int64_t> pick(0, kRange - 1);
+    std::vector<NearSetND<2>::Point> points(size);
+    for (auto& point : points) {
+        point = {pick(generator), pick(generator)};
+    }
+    int64_t distance = static_cast<int64_t>(kRange * std::sqrt(expected / size) / 2);
+
+    auto start = std::chrono::steady_clock::now();
+    StripNearSet2D strip;
+    for (const auto& point : points) {
+        strip.Add(point);
+    }
+    double strip_build = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    NearSetND<2> tree(points);
+    double tree_build = Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    NearSetND<2> incremental;
+    for (const auto& point : points) {
+        incremental.Add(point);
+    }
+    double incremental_build = Seconds(start);
+
+    std::vector<NearSetND<2>::Point> queries(kQueries);
+    for (auto& query : queries) {
+        query = {pick(generator), pick(generator)};
+    }
+    size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (const auto& query : queries) {
+        found += strip.FindNear(query, distance).size();
+    }
+    double strip_find = kQueries / Seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const auto& query : queries) {
+        found -= tree.FindNear(query, distance).size();
+    }
+    double tree_find = kQueries / Seconds(start);
+
+    if (found != 0) {
+        std::cout << "results disagree" << std::endl;
+    }
+    std::cout << "2-D, " << size << " points, ~" << expected << " per cube: x strip "
+              << static_cast<size_t>(strip_find) << " queries/s (built in " << strip_build
+              << " s), k-d tree " << static_cast<size_t>(tree_find) << " queries/s (bulk load "
+              << tree_build << " s, one by one " << incremental_build << " s)" << std::endl;
+}
+
+int main() {
+    for (size_t size : {100000, 1000000, 10000000}) {
+        Bench<SetNearSet>("std::set", size, 4);
+        Bench<NearSet>("B+-tree", size, 4);
+    }
+    for (size_t size : {1000000, 10000000}) {
+        for (int64_t expected : {4, 100}) {
+            BenchQueries(size, expected);
+        }
+    }
+    for (size_t size : {1000000, 10000000}) {
+        for (size_t batch : {100, 10000}) {
+            BenchSnapshots(size, batch);
+        }
+    }
+    for (size_t size : {100000, 1000000, 4000000}) {
+        for (double expected : {4.0, 100.0}) {
+            BenchND(size, expected);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "near_set.h"
+
+// NearSet for many reader threads and rare writers. Readers query an
+// immutable snapshot and never wait: entering and leaving a read costs one
+// atomic increment and decrement on a counter shared by few threads.
+// Writers queue Add and Remove, and Publish applies the queue as a new
+// snapshot, so readers see either all of a batch or none of it.
+//
+// A snapshot is a sorted run of immutable 512-byte blocks plus a directory
+// of their first keys. Publish copies the directory but only rebuilds the
+// blocks that the batch touches; the rest are shared with the previous
+// snapshot. Reclamation is counter-based RCU: readers count themselves in
+// one of two sets of striped counters, and after swapping the snapshot
+// Publish flips readers over to the other set and waits for each set in
+// turn to drain before freeing what the old snapshot alone used.
+class ConcurrentNearSet {
+ public:
+    ConcurrentNearSet();
+    ~ConcurrentNearSet();
+
+    ConcurrentNearSet(const ConcurrentNearSet&) = delete;
+    ConcurrentNearSet& operator=(const ConcurrentNearSet&) = delete;
+
+    // Queued until the next Publish; the last queued change of a point
+    // wins.
+    void Add(int64_t point);
+    void Remove(int64_t point);
+
+    // Makes the queued changes visible. Waits for the reads that may still
+    // see the previous snapshot, so it must not be called from a visitor.
+    void Publish();
+
+    // As in NearSet, on the latest published snapshot.
+    std::vector<int64_t> FindNear(int64_t point, int64_t distance) const;
+    size_t CountNear(int64_t point, int64_t distance) const;
+    template <class Visitor>
+    void ForEachNear(int64_t point, int64_t distance, Visitor visitor) const;
+
+    size_t Size() const;
+
+ private:
+    static constexpr int kBlockCapacity = 63;
+    static constexpr int kStripes = 64;
+
+    struct alignas(64) Block {
+        uint32_t size = 0;
+        int64_t keys[kBlockCapacity];
+    };
+
+    static_assert(sizeof(Block) == 512, "blocks are eight cache lines");
+
+    struct Snapshot {
+        // firsts[i] is blocks[i]->keys[0]; no block is empty.
+        std::vector<int64_t> firsts;
+        std::vector<const Block*> blocks;
+        size_t size = 0;
+    };
+
+    struct alignas(64) Counter {
+        std::atomic<int64_t> readers{0};
+    };
+
+    // Pins the snapshot it loaded for as long as it lives.
+    class ReadGuard {
+     public:
+        explicit ReadGuard(const ConcurrentNearSet* set);
+        ~ReadGuard();
+
+        const Snapshot* snapshot() const {
+            return snapshot_;
+        }
+
+     private:
+        std::atomic<int64_t>* counter_;
+        const Snapshot* snapshot_;
+    };
+
+    std::atomic<const Snapshot*> snapshot_;
+    mutable std::atomic<int> phase_{0};
+    mutable Counter counters_[2][kStripes];
+
+    std::mutex pending_mutex_;
+    std::vector<std::pair<int64_t, bool>> pending_;
+    std::mutex publish_mutex_;
+
+    static int stripe_();
+
+    // Appends `keys` to `snapshot` as blocks filled to about 3/4.
+    static void append_blocks_(const std::vector<int64_t>& keys, Snapshot* snapshot);
+
+    // Returns once no read that started before the call is running.
+    void synchronize_() const;
+
+    // Index of the first block that may hold `point`.
+    static size_t find_block_(const Snapshot& snapshot, int64_t point);
+
+    template <class Visitor>
+    static void visit_(const Snapshot& snapshot, int64_t low, int64_t high, Visitor visitor);
+};
+
+inline ConcurrentNearSet::ConcurrentNearSet() : snapshot_(new Snapshot) {}
+
+inline ConcurrentNearSet::~ConcurrentNearSet() {
+    const Snapshot* snapshot = snapshot_.load();
+    for (const Block* block : snapshot->blocks) {
+        delete block;
+    }
+    delete snapshot;
+}
+
+inline void ConcurrentNearSet::Add(int64_t point) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.emplace_back(point, true);
+}
+
+inline void ConcurrentNearSet::Remove(int64_t point) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.emplace_back(point, false);
+}
+
+inline void ConcurrentNearSet::Publish() {
+    std::lock_guard<std::mutex> publish_lock(publish_mutex_);
+    std::vector<std::pair<int64_t, bool>> changes;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        changes.swap(pending_);
+    }
+    if (changes.empty()) {
+        return;
+    }
+    // Sorted by point with the last change of each point kept.
+    std::stable_sort(changes.begin(), changes.end(),
+                     [](const std::pair<int64_t, bool>& lhs, const std::pair<int64_t, bool>& rhs) {
+                         return lhs.first < rhs.first;
+                     });
+    size_t unique = 0;
+    for (size_t i = 0; i < changes.size(); ++i) {
+        if (i + 1 < changes.size() && changes[i + 1].first == changes[i].first) {
+            continue;
+        }
+        changes[unique++] = changes[i];
+    }
+    changes.resize(unique);
+
+    // Blocks without changes are shared; a run of changed blocks is merged
+    // with its changes and cut into fresh blocks.
+    const Snapshot* old = snapshot_.load(std::memory_order_relaxed);
+    Snapshot* snapshot = new Snapshot;
+    snapshot->firsts.reserve(old->blocks.size() + 1);
+    snapshot->blocks.reserve(old->blocks.size() + 1);
+    std::vector<const Block*> retired;
+    std::vector<int64_t> run;
+    size_t change = 0;
+    size_t count = old->blocks.size();
+    for (size_t i = 0; i < count || change < changes.size(); ++i) {
+        // Changes past the last block go to it, or to a new one.
+        size_t end = changes.size();
+        if (i + 1 < count) {
+            int64_t next_first = old->firsts[i + 1];
+            end = std::lower_bound(changes.begin() + change, changes.end(), next_first,
+                                   [](const std::pair<int64_t, bool>& lhs, int64_t rhs) {
+                                       return lhs.first < rhs;
+                                   }) - changes.begin();
+        }
+        const Block* block = i < count ? old->blocks[i] : nullptr;
+        if (change == end && run.empty()) {
+            if (block) {
+                snapshot->firsts.push_back(old->firsts[i]);
+                snapshot->blocks.push_back(block);
+                snapshot->size += block->size;
+            }
+            continue;
+        }
+        const int64_t* keys = block ? block->keys : nullptr;
+        const int64_t* keys_end = block ? block->keys + block->size : nullptr;
+        if (block) {
+            retired.push_back(block);
+        }
+        for (; change < end; ++change) {
+            int64_t point = changes[change].first;
+            for (; keys != keys_end && *keys < point; ++keys) {
+                run.push_back(*keys);
+            }
+            if (keys != keys_end && *keys == point) {
+                ++keys;
+            }
+            if (changes[change].second) {
+                run.push_back(point);
+            }
+        }
+        run.insert(run.end(), keys, keys_end);
+        // A short run takes in the next block instead of leaving a small one.
+        if (run.size() >= kBlockCapacity / 2 || i + 1 >= count) {
+            append_blocks_(run, snapshot);
+            run.clear();
+        }
+    }
+    if (!run.empty()) {
+        append_blocks_(run, snapshot);
+    }
+
+    snapshot_.store(snapshot, std::memory_order_seq_cst);
+    synchronize_();
+    for (const Block* block : retired) {
+        delete block;
+    }
+    delete old;
+}
+
+inline std::vector<int64_t> ConcurrentNearSet::FindNear(int64_t point, int64_t distance) const {
+    std::vector<int64_t> ans;
+    ForEachNear(point, distance, [&ans](int64_t x) {
+        ans.push_back(x);
+    });
+    return ans;
+}
+
+inline size_t ConcurrentNearSet::CountNear(int64_t point, int64_t distance) const {
+    int64_t low, high;
+    if (!NearWindow(point, distance, &low, &high)) {
+        return 0;
+    }
+    ReadGuard guard(this);
+    const Snapshot& snapshot = *guard.snapshot();
+    size_t count = 0;
+    for (size_t i = find_block_(snapshot, low); i < snapshot.blocks.size(); ++i) {
+        const Block* block = snapshot.blocks[i];
+        if (block->keys[0] > high) {
+            break;
+        }
+        const int64_t* end = block->keys + block->size;
+        count += std::upper_bound(block->keys, end, high) -
+                 std::lower_bound(block->keys, end, low);
+    }
+    return count;
+}
+
+template <class Visitor>
+void ConcurrentNearSet::ForEachNear(int64_t point, int64_t distance, Visitor visitor) const {
+    int64_t low, high;
+    if (NearWindow(point, distance, &low, &high)) {
+        ReadGuard guard(this);
+        visit_(*guard.snapshot(), low, high, visitor);
+    }
+}
+
+inline size_t ConcurrentNearSet::Size() const {
+    ReadGuard guard(this);
+    return guard.snapshot()->size;
+}
+
+// The increment is ordered before the snapshot load, so a Publish that
+// swaps the snapshot afterwards sees this reader in its counters.
+inline ConcurrentNearSet::ReadGuard::ReadGuard(const ConcurrentNearSet* set) {
+    int phase = set->phase_.load(std::memory_order_seq_cst);
+    counter_ = &set->counters_[phase][stripe_()].readers;
+    counter_->fetch_add(1, std::memory_order_seq_cst);
+    snapshot_ = set->snapshot_.load(std::memory_order_seq_cst);
+}
+
+inline ConcurrentNearSet::ReadGuard::~ReadGuard() {
+    counter_->fetch_sub(1, std::memory_order_release);
+}
+
+inline int ConcurrentNearSet::stripe_() {
+    static std::atomic<int> next{0};
+    thread_local int stripe = next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return stripe;
+}
+
+inline void ConcurrentNearSet::append_blocks_(const std::vector<int64_t>& keys,
+                                              Snapshot* snapshot) {
+    const size_t kFill = kBlockCapacity * 3 / 4;
+    size_t blocks = (keys.size() + kFill - 1) / kFill;
+    for (size_t i = 0; i < blocks; ++i) {
+        size_t begin = keys.size() * i / blocks;
+        size_t end = keys.size() * (i + 1) / blocks;
+        Block* block = new Block;
+        block->size = end - begin;
+        std::copy(keys.begin() + begin, keys.begin() + end, block->keys);
+        snapshot->firsts.push_back(block->keys[0]);
+        snapshot->blocks.push_back(block);
+        snapshot->size += block->size;
+    }
+}
+
+// A reader that read phase_ long ago may count itself in either set, so
+// both are drained. New readers are sent to the other set first, so that
+// the one being drained empties even while reads keep starting.
+inline void ConcurrentNearSet::synchronize_() const {
+    for (int flip = 0; flip < 2; ++flip) {
+        int phase = phase_.load(std::memory_order_relaxed);
+        phase_.store(1 - phase, std::memory_order_seq_cst);
+        for (const Counter& counter : counters_[phase]) {
+            while (counter.readers.load(std::memory_order_seq_cst) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+inline size_t ConcurrentNearSet::find_block_(const Snapshot& snapshot, int64_t point) {
+    size_t index = std::upper_bound(snapshot.firsts.begin(), snapshot.firsts.end(), point) -
+                   snapshot.firsts.begin();
+    return index == 0 ? 0 : index - 1;
+}
+
+template <class Visitor>
+void ConcurrentNearSet::visit_(const Snapshot& snapshot, int64_t low, int64_t high,
+                               Visitor visitor) {
+    for (size_t i = find_block_(snapshot, low); i < snapshot.blocks.size(); ++i) {
+        const Block* block = snapshot.blocks[i];
+        const int64_t* end = block->keys + block->size;
+        for (const int64_t* key = std::lower_bound(block->keys, end, low); key != end; ++key) {
+            if (*key > high) {
+                return;
+            }
+            visitor(*key);
+        }
+    }
+}
@@ -2,30 +2,443 @@
 
 #include <vector>
 #include <cstdint>
-#include <set>
+#include <cstring>
+#include <limits>
+#include <utility>
 
+// Sets [low, high] to the keys within `distance` of `point`, clamped to the
+// int64_t range. Returns false if distance is negative.
+inline bool NearWindow(int64_t point, int64_t distance, int64_t* low, int64_t* high) {
+    if (distance < 0) {
+        return false;
+    }
+    const int64_t kMin = std::numeric_limits<int64_t>::min();
+    const int64_t kMax = std::numeric_limits<int64_t>::max();
+    *low = point < kMin + distance ? kMin : point - distance;
+    *high = point > kMax - distance ? kMax : point + distance;
+    return true;
+}
+
+// Set of points kept in a B+-tree. Leaves and inner nodes are four cache
+// lines each and 64-byte aligned, keys are searched with a linear count
+// that the compiler vectorizes, and the leaves form a linked list in key
+// order, so FindNear descends once and then reads consecutive keys. Nodes
+// are allocated only when they split, not on every Add.
 class NearSet {
  public:
-    void Add(int64_t point) {
-        set_.insert(point);
-    }
+    NearSet();
+    ~NearSet();
 
-    void Remove(int64_t point) {\
-        set_.erase(point);
-    }
+    NearSet(const NearSet&) = delete;
+    NearSet& operator=(const NearSet&) = delete;
+
+    NearSet(NearSet&& other);
+    NearSet& operator=(NearSet&& other);
+
+    void Add(int64_t point);
+
+    void Remove(int64_t point);
 
     // find all points x in set, such that abs(x - point) <= distance
     // returned vector must be sorted
-    std::vector<int64_t> FindNear(int64_t point, int64_t distance) {
-        std::set<int64_t>::iterator it = set_.lower_bound(point - distance);
-        std::vector<int64_t> ans;
-        while(it!=set_.end() && std::abs(*it - point) <= distance) {
-            ans.push_back(*it);
-            ++it;
-        }
-        return ans;
-    }
+    std::vector<int64_t> FindNear(int64_t point, int64_t distance) const;
+
+    // The same points, counted or passed to visitor(x) in order, without
+    // building a vector. CountNear adds up whole leaves inside the window.
+    size_t CountNear(int64_t point, int64_t distance) const;
+    template <class Visitor>
+    void ForEachNear(int64_t point, int64_t distance, Visitor visitor) const;
+
+    // FindNear for every query: the points near points[i] end up in
+    // (*found)[(*offsets)[i] .. (*offsets)[i + 1]). Both vectors are
+    // overwritten, so reusing them across calls allocates nothing. Sorted
+    // queries are answered in one sweep over the leaves, each starting
+    // where the previous one did instead of from the root; any order is
+    // still answered correctly.
+    void FindNearBatch(const std::vector<int64_t>& points, int64_t distance,
+                       std::vector<int64_t>* found, std::vector<size_t>* offsets) const;
+
+    size_t Size() const;
 
  private:
-    std::set<int64_t> set_;
+    static constexpr int kLeafCapacity = 30;
+    static constexpr int kInnerCapacity = 15;
+
+    struct Node {
+    };
+
+    struct alignas(64) Leaf : Node {
+        int64_t keys[kLeafCapacity];
+        uint32_t size = 0;
+        Leaf* next = nullptr;
+    };
+
+    // children[i] holds the keys in [keys[i - 1], keys[i]).
+    struct alignas(64) Inner : Node {
+        int64_t keys[kInnerCapacity];
+        uint32_t size = 0;
+        Node* children[kInnerCapacity + 1];
+    };
+
+    static_assert(sizeof(Leaf) == 256 && sizeof(Inner) == 256, "nodes are four cache lines");
+
+    Node* root_;
+    // Levels of inner nodes above the leaves.
+    int height_ = 0;
+    size_t size_ = 0;
+
+    // Number of keys less than `key`, or not greater than it.
+    static int count_less_(const int64_t* keys, int size, int64_t key);
+    static int count_not_greater_(const int64_t* keys, int size, int64_t key);
+
+    static void destroy_(Node* node, int height);
+
+    // Inserts into the subtree at `node`. If the node had to split, returns
+    // the new right half and sets `separator` to its smallest key.
+    Node* insert_(Node* node, int height, int64_t point, int64_t* separator);
+    Leaf* insert_leaf_(Leaf* leaf, int64_t point, int64_t* separator);
+
+    // Removes from the subtree at `node` and refills the child it went
+    // through if that one became less than half full.
+    void remove_(Node* node, int height, int64_t point);
+    // Merges or evens out children `index` and `index + 1` of `parent`.
+    void rebalance_(Inner* parent, int index, int height);
+
+    // The leaf whose range holds `point`.
+    const Leaf* find_leaf_(int64_t point) const;
+
+    // Visits the keys in [low, high] from `leaf` on, which must not start
+    // after `low`.
+    template <class Visitor>
+    static void visit_(const Leaf* leaf, int64_t low, int64_t high, Visitor visitor);
 };
+
+inline NearSet::NearSet() : root_(new Leaf) {}
+
+inline NearSet::~NearSet() {
+    destroy_(root_, height_);
+}
+
+inline NearSet::NearSet(NearSet&& other) : root_(new Leaf) {
+    *this = std::move(other);
+}
+
+inline NearSet& NearSet::operator=(NearSet&& other) {
+    std::swap(root_, other.root_);
+    std::swap(height_, other.height_);
+    std::swap(size_, other.size_);
+    return *this;
+}
+
+inline void NearSet::Add(int64_t point) {
+    int64_t separator;
+    Node* sibling = insert_(root_, height_, point, &separator);
+    if (sibling) {
+        Inner* root = new Inner;
+        root->size = 1;
+        root->keys[0] = separator;
+        root->children[0] = root_;
+        root->children[1] = sibling;
+        root_ = root;
+        ++height_;
+    }
+}
+
+inline void NearSet::Remove(int64_t point) {
+    remove_(root_, height_, point);
+    if (height_ > 0 && static_cast<Inner*>(root_)->size == 0) {
+        Inner* root = static_cast<Inner*>(root_);
+        root_ = root->children[0];
+        --height_;
+        delete root;
+    }
+}
+
+inline std::vector<int64_t> NearSet::FindNear(int64_t point, int64_t distance) const {
+    std::vector<int64_t> ans;
+    ForEachNear(point, distance, [&ans](int64_t x) {
+        ans.push_back(x);
+    });
+    return ans;
+}
+
+inline size_t NearSet::CountNear(int64_t point, int64_t distance) const {
+    int64_t low, high;
+    if (!NearWindow(point, distance, &low, &high)) {
+        return 0;
+    }
+    const Leaf* leaf = find_leaf_(low);
+    size_t count = 0;
+    int begin = count_less_(leaf->keys, leaf->size, low);
+    while (leaf && leaf->size > 0) {
+        if (leaf->keys[leaf->size - 1] > high) {
+            return count + count_not_greater_(leaf->keys, leaf->size, high) - begin;
+        }
+        count += leaf->size - begin;
+        leaf = leaf->next;
+        begin = 0;
+    }
+    return count;
+}
+
+template <class Visitor>
+void NearSet::ForEachNear(int64_t point, int64_t distance, Visitor visitor) const {
+    int64_t low, high;
+    if (NearWindow(point, distance, &low, &high)) {
+        visit_(find_leaf_(low), low, high, visitor);
+    }
+}
+
+inline void NearSet::FindNearBatch(const std::vector<int64_t>& points, int64_t distance,
+                                   std::vector<int64_t>* found,
+                                   std::vector<size_t>* offsets) const {
+    found->clear();
+    offsets->assign(1, 0);
+    const Leaf* leaf = nullptr;
+    int64_t previous_low = 0;
+    for (int64_t point : points) {
+        int64_t low, high;
+        if (NearWindow(point, distance, &low, &high)) {
+            // Keys before `leaf` are all below the previous query's low
+            // end. While queries go up, that leaf or the one after it is
+            // where the next one starts; others go through the root.
+            if (leaf && (low < previous_low || leaf->size == 0)) {
+                leaf = nullptr;
+            }
+            if (leaf && leaf->keys[leaf->size - 1] < low) {
+                const Leaf* next = leaf->next;
+                leaf = next && next->keys[next->size - 1] >= low ? next : nullptr;
+            }
+            if (!leaf) {
+                leaf = find_leaf_(low);
+            }
+            previous_low = low;
+            visit_(leaf, low, high, [found](int64_t x) {
+                found->push_back(x);
+            });
+        }
+        offsets->push_back(found->size());
+    }
+}
+
+inline size_t NearSet::Size() const {
+    return size_;
+}
+
+inline int NearSet::count_less_(const int64_t* keys, int size, int64_t key) {
+    int count = 0;
+    for (int i = 0; i < size; ++i) {
+        count += keys[i] < key;
+    }
+    return count;
+}
+
+inline int NearSet::count_not_greater_(const int64_t* keys, int size, int64_t key) {
+    int count = 0;
+    for (int i = 0; i < size; ++i) {
+        count += keys[i] <= key;
+    }
+    return count;
+}
+
+inline void NearSet::destroy_(Node* node, int height) {
+    if (height == 0) {
+        delete static_cast<Leaf*>(node);
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for (uint32_t i = 0; i <= inner->size; ++i) {
+        destroy_(inner->children[i], height - 1);
+    }
+    delete inner;
+}
+
+inline NearSet::Node* NearSet::insert_(Node* node, int height, int64_t point,
+                                       int64_t* separator) {
+    if (height == 0) {
+        return insert_leaf_(static_cast<Leaf*>(node), point, separator);
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    int index = count_not_greater_(inner->keys, inner->size, point);
+    int64_t child_separator;
+    Node* child_sibling = insert_(inner->children[index], height - 1, point, &child_separator);
+    if (!child_sibling) {
+        return nullptr;
+    }
+
+    // Room for one more key and child before splitting.
+    int64_t keys[kInnerCapacity + 1];
+    Node* children[kInnerCapacity + 2];
+    int size = inner->size;
+    std::memcpy(keys, inner->keys, index * sizeof(int64_t));
+    keys[index] = child_separator;
+    std::memcpy(keys + index + 1, inner->keys + index, (size - index) * sizeof(int64_t));
+    std::memcpy(children, inner->children, (index + 1) * sizeof(Node*));
+    children[index + 1] = child_sibling;
+    std::memcpy(children + index + 2, inner->children + index + 1,
+                (size - index) * sizeof(Node*));
+    ++size;
+
+    if (size <= kInnerCapacity) {
+        std::memcpy(inner->keys, keys, size * sizeof(int64_t));
+        std::memcpy(inner->children, children, (size + 1) * sizeof(Node*));
+        inner->size = size;
+        return nullptr;
+    }
+    // The middle key moves up; each half keeps the children around it.
+    int left = size / 2;
+    Inner* right = new Inner;
+    inner->size = left;
+    std::memcpy(inner->keys, keys, left * sizeof(int64_t));
+    std::memcpy(inner->children, children, (left + 1) * sizeof(Node*));
+    *separator = keys[left];
+    right->size = size - left - 1;
+    std::memcpy(right->keys, keys + left + 1, right->size * sizeof(int64_t));
+    std::memcpy(right->children, children + left + 1, (right->size + 1) * sizeof(Node*));
+    return right;
+}
+
+inline NearSet::Leaf* NearSet::insert_leaf_(Leaf* leaf, int64_t point, int64_t* separator) {
+    int index = count_less_(leaf->keys, leaf->size, point);
+    if (index < static_cast<int>(leaf->size) && leaf->keys[index] == point) {
+        return nullptr;
+    }
+    ++size_;
+    if (leaf->size < kLeafCapacity) {
+        std::memmove(leaf->keys + index + 1, leaf->keys + index,
+                     (leaf->size - index) * sizeof(int64_t));
+        leaf->keys[index] = point;
+        ++leaf->size;
+        return nullptr;
+    }
+    Leaf* right = new Leaf;
+    int left = (kLeafCapacity + 1) / 2;
+    int64_t keys[kLeafCapacity + 1];
+    std::memcpy(keys, leaf->keys, index * sizeof(int64_t));
+    keys[index] = point;
+    std::memcpy(keys + index + 1, leaf->keys + index, (kLeafCapacity - index) * sizeof(int64_t));
+    std::memcpy(leaf->keys, keys, left * sizeof(int64_t));
+    leaf->size = left;
+    right->size = kLeafCapacity + 1 - left;
+    std::memcpy(right->keys, keys + left, right->size * sizeof(int64_t));
+    right->next = leaf->next;
+    leaf->next = right;
+    *separator = right->keys[0];
+    return right;
+}
+
+inline void NearSet::remove_(Node* node, int height, int64_t point) {
+    if (height == 0) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        int index = count_less_(leaf->keys, leaf->size, point);
+        if (index < static_cast<int>(leaf->size) && leaf->keys[index] == point) {
+            std::memmove(leaf->keys + index, leaf->keys + index + 1,
+                         (leaf->size - index - 1) * sizeof(int64_t));
+            --leaf->size;
+            --size_;
+        }
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    int index = count_not_greater_(inner->keys, inner->size, point);
+    Node* child = inner->children[index];
+    remove_(child, height - 1, point);
+    bool underfull = height == 1
+        ? static_cast<Leaf*>(child)->size < kLeafCapacity / 2
+        : static_cast<Inner*>(child)->size < kInnerCapacity / 2;
+    if (underfull) {
+        rebalance_(inner, index == static_cast<int>(inner->size) ? index - 1 : index, height);
+    }
+}
+
+inline void NearSet::rebalance_(Inner* parent, int index, int height) {
+    int64_t& separator = parent->keys[index];
+    bool merged;
+    if (height == 1) {
+        Leaf* left = static_cast<Leaf*>(parent->children[index]);
+        Leaf* right = static_cast<Leaf*>(parent->children[index + 1]);
+        int total = left->size + right->size;
+        merged = total <= kLeafCapacity;
+        if (merged) {
+            std::memcpy(left->keys + left->size, right->keys, right->size * sizeof(int64_t));
+            left->size = total;
+            left->next = right->next;
+            delete right;
+        } else if (left->size < right->size) {
+            int move = (total + 1) / 2 - left->size;
+            std::memcpy(left->keys + left->size, right->keys, move * sizeof(int64_t));
+            std::memmove(right->keys, right->keys + move,
+                         (right->size - move) * sizeof(int64_t));
+            left->size += move;
+            right->size -= move;
+            separator = right->keys[0];
+        } else {
+            int move = (total + 1) / 2 - right->size;
+            std::memmove(right->keys + move, right->keys, right->size * sizeof(int64_t));
+            std::memcpy(right->keys, left->keys + left->size - move, move * sizeof(int64_t));
+            left->size -= move;
+            right->size += move;
+            separator = right->keys[0];
+        }
+    } else {
+        // The separator comes down between the two halves' keys, and the
+        // middle of the combined keys goes back up.
+        Inner* left = static_cast<Inner*>(parent->children[index]);
+        Inner* right = static_cast<Inner*>(parent->children[index + 1]);
+        int total = left->size + 1 + right->size;
+        merged = total <= kInnerCapacity;
+        int64_t keys[2 * kInnerCapacity + 1];
+        Node* children[2 * kInnerCapacity + 2];
+        std::memcpy(keys, left->keys, left->size * sizeof(int64_t));
+        keys[left->size] = separator;
+        std::memcpy(keys + left->size + 1, right->keys, right->size * sizeof(int64_t));
+        std::memcpy(children, left->children, (left->size + 1) * sizeof(Node*));
+        std::memcpy(children + left->size + 1, right->children, (right->size + 1) * sizeof(Node*));
+        if (merged) {
+            std::memcpy(left->keys, keys, total * sizeof(int64_t));
+            std::memcpy(left->children, children, (total + 1) * sizeof(Node*));
+            left->size = total;
+            delete right;
+        } else {
+            int half = total / 2;
+            std::memcpy(left->keys, keys, half * sizeof(int64_t));
+            std::memcpy(left->children, children, (half + 1) * sizeof(Node*));
+            left->size = half;
+            separator = keys[half];
+            right->size = total - half - 1;
+            std::memcpy(right->keys, keys + half + 1, right->size * sizeof(int64_t));
+            std::memcpy(right->children, children + half + 1, (right->size + 1) * sizeof(Node*));
+        }
+    }
+    if (merged) {
+        std::memmove(parent->keys + index, parent->keys + index + 1,
+                     (parent->size - index - 1) * sizeof(int64_t));
+        std::memmove(parent->children + index + 1, parent->children + index + 2,
+                     (parent->size - index - 1) * sizeof(Node*));
+        --parent->size;
+    }
+}
+
+template <class Visitor>
+void NearSet::visit_(const Leaf* leaf, int64_t low, int64_t high, Visitor visitor) {
+    int i = count_less_(leaf->keys, leaf->size, low);
+    while (leaf) {
+        for (; i < static_cast<int>(leaf->size); ++i) {
+            if (leaf->keys[i] > high) {
+                return;
+            }
+            visitor(leaf->keys[i]);
+        }
+        leaf = leaf->next;
+        i = 0;
+    }
+}
+
+inline const NearSet::Leaf* NearSet::find_leaf_(int64_t point) const {
+    const Node* node = root_;
+    for (int height = height_; height > 0; --height) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        node = inner->children[count_not_greater_(inner->keys, inner->size, point)];
+    }
+    return static_cast<const Leaf*>(node);
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+
+#include "near_set.h"
+
+// NearSet for K-dimensional points: FindNear returns the points within
+// `distance` of `point` in every coordinate (a cube around it), sorted.
+//
+// Backed by a k-d tree with buckets of up to 2 * kLeafSize points at the
+// leaves. A bulk load splits at the median of the widest coordinate, so the
+// tree starts balanced. Add appends to the leaf it reaches and splits that
+// leaf when it overflows; Remove takes the point out of its leaf. Once the
+// changes since the last build outnumber the points it was built with, the
+// whole tree is rebuilt, which keeps the cost of skewed inserts amortized
+// O(log n).
+template <int K>
+class NearSetND {
+ public:
+    typedef std::array<int64_t, K> Point;
+
+    NearSetND() {}
+
+    // Bulk load; duplicates are dropped.
+    explicit NearSetND(std::vector<Point> points);
+
+    void Add(const Point& point);
+
+    void Remove(const Point& point);
+
+    // find all points x in set, such that abs(x[i] - point[i]) <= distance
+    // for every i; returned vector is sorted
+    std::vector<Point> FindNear(const Point& point, int64_t distance) const;
+
+    size_t Size() const;
+
+ private:
+    static constexpr int kLeafSize = 16;
+
+    // An inner node sends points whose `axis` coordinate is below `split`
+    // to `left`. A leaf has axis -1 and its points in buckets_[left].
+    struct Node {
+        int64_t split = 0;
+        int32_t axis = -1;
+        int32_t left = 0;
+        int32_t right = 0;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<std::vector<Point>> buckets_;
+    size_t size_ = 0;
+    size_t changes_ = 0;
+    size_t built_size_ = 0;
+
+    void rebuild_();
+    // Builds the subtree for points[begin, end) into node `index`.
+    void build_(std::vector<Point>* points, size_t begin, size_t end, int32_t index);
+    // The leaf bucket `point` belongs to.
+    int32_t find_leaf_(const Point& point) const;
+
+    void collect_(int32_t index, const Point& low, const Point& high,
+                  std::vector<Point>* found) const;
+};
+
+template <int K>
+NearSetND<K>::NearSetND(std::vector<Point> points) {
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+    size_ = points.size();
+    built_size_ = size_;
+    nodes_.emplace_back();
+    build_(&points, 0, points.size(), 0);
+}
+
+template <int K>
+void NearSetND<K>::Add(const Point& point) {
+    if (nodes_.empty()) {
+        nodes_.emplace_back();
+        buckets_.emplace_back();
+    }
+    int32_t leaf = find_leaf_(point);
+    std::vector<Point>& bucket = buckets_[nodes_[leaf].left];
+    if (std::find(bucket.begin(), bucket.end(), point) != bucket.end()) {
+        return;
+    }
+    bucket.push_back(point);
+    ++size_;
+    if (++changes_ > std::max<size_t>(built_size_, kLeafSize)) {
+        rebuild_();
+    } else if (bucket.size() > 2 * kLeafSize) {
+        // The emptied bucket stays unused until the next rebuild.
+        std::vector<Point> points = std::move(bucket);
+        build_(&points, 0, points.size(), leaf);
+    }
+}
+
+template <int K>
+void NearSetND<K>::Remove(const Point& point) {
+    if (nodes_.empty()) {
+        return;
+    }
+    std::vector<Point>& bucket = buckets_[nodes_[find_leaf_(point)].left];
+    auto it = std::find(bucket.begin(), bucket.end(), point);
+    if (it == bucket.end()) {
+        return;
+    }
+    *it = bucket.back();
+    bucket.pop_back();
+    --size_;
+    if (++changes_ > std::max<size_t>(built_size_, kLeafSize)) {
+        rebuild_();
+    }
+}
+
+template <int K>
+std::vector<typename NearSetND<K>::Point> NearSetND<K>::FindNear(const Point& point,
+                                                                int64_t distance) const {
+    std::vector<Point> found;
+    if (distance < 0 || nodes_.empty()) {
+        return found;
+    }
+    Point low, high;
+    for (int i = 0; i < K; ++i) {
+        NearWindow(point[i], distance, &low[i], &high[i]);
+    }
+    collect_(0, low, high, &found);
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+template <int K>
+size_t NearSetND<K>::Size() const {
+    return size_;
+}
+
+template <int K>
+void NearSetND<K>::rebuild_() {
+    std::vector<Point> points;
+    points.reserve(size_);
+    for (const auto& bucket : buckets_) {
+        points.insert(points.end(), bucket.begin(), bucket.end());
+    }
+    nodes_.assign(1, Node());
+    buckets_.clear();
+    changes_ = 0;
+    built_size_ = size_;
+    build_(&points, 0, points.size(), 0);
+}
+
+template <int K>
+void NearSetND<K>::build_(std::vector<Point>* points, size_t begin, size_t end,
+                          int32_t index) {
+    auto first = points->begin() + begin;
+    auto last = points->begin() + end;
+    if (end - begin > kLeafSize) {
+        // Splits along the widest coordinate; the points equal to the
+        // median go right, so a side may only be empty if every point has
+        // the same value there, and then the next widest is tried.
+        std::array<std::pair<uint64_t, int>, K> spreads;
+        for (int axis = 0; axis < K; ++axis) {
+            auto bounds = std::minmax_element(first, last, [axis](const Point& lhs, const Point& rhs) {
+                return lhs[axis] < rhs[axis];
+            });
+            spreads[axis] = {uint64_t((*bounds.second)[axis]) - uint64_t((*bounds.first)[axis]),
+                             axis};
+        }
+        std::sort(spreads.rbegin(), spreads.rend());
+        for (const auto& spread : spreads) {
+            int axis = spread.second;
+            auto less = [axis](const Point& lhs, const Point& rhs) {
+                return lhs[axis] < rhs[axis];
+            };
+            auto middle = first + (end - begin) / 2;
+            std::nth_element(first, middle, last, less);
+            int64_t split = (*middle)[axis];
+            middle = std::partition(first, last, [axis, split](const Point& point) {
+                return point[axis] < split;
+            });
+            if (middle == first) {
+                // The median is the minimum: split above it instead.
+                auto above = std::partition(first, last, [axis, split](const Point& point) {
+                    return point[axis] == split;
+                });
+                if (above == last) {
+                    continue;
+                }
+                split = std::min_element(above, last, less)->at(axis);
+                middle = above;
+            }
+            size_t split_at = middle - points->begin();
+            int32_t left = nodes_.size();
+            nodes_.emplace_back();
+            nodes_.emplace_back();
+            nodes_[index].split = split;
+            nodes_[index].axis = axis;
+            nodes_[index].left = left;
+            nodes_[index].right = left + 1;
+            build_(points, begin, split_at, left);
+            build_(points, split_at, end, left + 1);
+            return;
+        }
+    }
+    nodes_[index].axis = -1;
+    nodes_[index].left = buckets_.size();
+    buckets_.emplace_back(first, last);
+}
+
+template <int K>
+int32_t NearSetND<K>::find_leaf_(const Point& point) const {
+    int32_t index = 0;
+    while (nodes_[index].axis != -1) {
+        const Node& node = nodes_[index];
+        index = point[node.axis] < node.split ? node.left : node.right;
+    }
+    return index;
+}
+
+template <int K>
+void NearSetND<K>::collect_(int32_t index, const Point& low, const Point& high,
+                            std::vector<Point>* found) const {
+    const Node& node = nodes_[index];
+    if (node.axis == -1) {
+        for (const Point& point : buckets_[node.left]) {
+            bool inside = true;
+            for (int i = 0; i < K; ++i) {
+                inside &= low[i] <= point[i] && point[i] <= high[i];
+            }
+            if (inside) {
+                found->push_back(point);
+            }
+        }
+        return;
+    }
+    if (low[node.axis] < node.split) {
+        collect_(node.left, low, high, found);
+    }
+    if (high[node.axis] >= node.split) {
+        collect_(node.right, low, high, found);
+    }
+}
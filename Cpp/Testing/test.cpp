@@ -1,5 +1,13 @@
 #include "gtest/gtest.h"
 #include "near_set.h"
+#include "concurrent_near_set.h"
+#include "near_set_nd.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <set>
+#include <thread>
 
 TEST(NearSet, Simple) {
     NearSet nearSet;
@@ -35,3 +43,277 @@ TEST(NearSet, Simple) {
     ASSERT_EQ(kek, heh);
 
 }
+
+TEST(NearSet, MatchesStdSet) {
+    NearSet nearSet;
+    std::set<int64_t> expected;
+    std::mt19937_64 generator(42);
+    // Grows the tree to several levels, shrinks it back to a leaf, and
+    // checks queries at every stage, including ones spanning many leaves.
+    for (int64_t range : {int64_t(1000), int64_t(100000)}) {
+        for (int round = 0; round < 4; ++round) {
+            bool adding = round % 2 == 0;
+            for (int i = 0; i < 60000; ++i) {
+                int64_t point = std::uniform_int_distribution<int64_t>(0, range)(generator);
+                if (adding) {
+                    nearSet.Add(point);
+                    expected.insert(point);
+                } else {
+                    nearSet.Remove(point);
+                    expected.erase(point);
+                }
+            }
+            if (!adding) {
+                for (int64_t point : std::vector<int64_t>(expected.begin(), expected.end())) {
+                    if (point % 3 != 0) {
+                        nearSet.Remove(point);
+                        expected.erase(point);
+                    }
+                }
+            }
+            ASSERT_EQ(expected.size(), nearSet.Size());
+            for (int i = 0; i < 200; ++i) {
+                int64_t point = std::uniform_int_distribution<int64_t>(-10, range + 10)(generator);
+                int64_t distance = std::uniform_int_distribution<int64_t>(0, range / 50)(generator);
+                std::vector<int64_t> heh(expected.lower_bound(point - distance),
+                                         expected.upper_bound(point + distance));
+                ASSERT_EQ(heh, nearSet.FindNear(point, distance));
+            }
+        }
+    }
+    for (int64_t point : std::vector<int64_t>(expected.begin(), expected.end())) {
+        nearSet.Remove(point);
+    }
+    ASSERT_EQ(0u, nearSet.Size());
+    ASSERT_EQ(std::vector<int64_t>{}, nearSet.FindNear(0, 1000000));
+}
+
+TEST(NearSet, Extremes) {
+    const int64_t kMin = std::numeric_limits<int64_t>::min();
+    const int64_t kMax = std::numeric_limits<int64_t>::max();
+    NearSet nearSet;
+    nearSet.Add(kMin);
+    nearSet.Add(kMax);
+    nearSet.Add(0);
+    ASSERT_EQ((std::vector<int64_t>{kMin, 0}), nearSet.FindNear(-1, kMax));
+    ASSERT_EQ((std::vector<int64_t>{0, kMax}), nearSet.FindNear(kMax, kMax));
+    ASSERT_EQ((std::vector<int64_t>{kMin}), nearSet.FindNear(kMin, 0));
+    ASSERT_EQ(std::vector<int64_t>{}, nearSet.FindNear(5, -1));
+
+    NearSet moved = std::move(nearSet);
+    ASSERT_EQ(3u, moved.Size());
+    ASSERT_EQ(0u, nearSet.Size());
+}
+
+TEST(NearSet, CountAndBatch) {
+    NearSet nearSet;
+    std::mt19937_64 generator(7);
+    std::vector<int64_t> heh;
+    std::vector<size_t> offsets;
+    nearSet.FindNearBatch({1, 2}, 5, &heh, &offsets);
+    ASSERT_EQ((std::vector<size_t>{0, 0, 0}), offsets);
+    for (int i = 0; i < 50000; ++i) {
+        nearSet.Add(std::uniform_int_distribution<int64_t>(0, 1000000)(generator));
+    }
+
+    for (int64_t distance : {int64_t(-1), int64_t(0), int64_t(30), int64_t(2000)}) {
+        std::vector<int64_t> points;
+        for (int i = 0; i < 3000; ++i) {
+            points.push_back(std::uniform_int_distribution<int64_t>(-5000, 1005000)(generator));
+        }
+        // Unsorted, then sorted with runs of equal points.
+        for (int pass = 0; pass < 2; ++pass) {
+            nearSet.FindNearBatch(points, distance, &heh, &offsets);
+            ASSERT_EQ(points.size() + 1, offsets.size());
+            for (size_t i = 0; i < points.size(); ++i) {
+                std::vector<int64_t> kek = nearSet.FindNear(points[i], distance);
+                ASSERT_EQ(kek, std::vector<int64_t>(heh.begin() + offsets[i],
+                                                    heh.begin() + offsets[i + 1]));
+                ASSERT_EQ(kek.size(), nearSet.CountNear(points[i], distance));
+                std::vector<int64_t> visited;
+                nearSet.ForEachNear(points[i], distance, [&visited](int64_t x) {
+                    visited.push_back(x);
+                });
+                ASSERT_EQ(kek, visited);
+            }
+            std::sort(points.begin(), points.end());
+            points.insert(points.begin() + 100, 20, points[100]);
+        }
+    }
+}
+
+TEST(ConcurrentNearSet, MatchesStdSet) {
+    ConcurrentNearSet nearSet;
+    std::set<int64_t> expected;
+    std::mt19937_64 generator(11);
+    for (int64_t range : {int64_t(300), int64_t(100000)}) {
+        for (int batch = 0; batch < 60; ++batch) {
+            bool adding = batch % 3 != 2;
+            int changes = std::uniform_int_distribution<int>(1, 5000)(generator);
+            for (int i = 0; i < changes; ++i) {
+                int64_t point = std::uniform_int_distribution<int64_t>(0, range)(generator);
+                if (adding) {
+                    nearSet.Add(point);
+                    expected.insert(point);
+                } else {
+                    nearSet.Remove(point);
+                    expected.erase(point);
+                }
+            }
+            if (batch == 40) {
+                for (int64_t point : expected) {
+                    nearSet.Remove(point);
+                }
+                expected.clear();
+            }
+            nearSet.Publish();
+            ASSERT_EQ(expected.size(), nearSet.Size());
+            for (int i = 0; i < 50; ++i) {
+                int64_t point = std::uniform_int_distribution<int64_t>(-10, range + 10)(generator);
+                int64_t distance = std::uniform_int_distribution<int64_t>(0, range / 20)(generator);
+                std::vector<int64_t> heh(expected.lower_bound(point - distance),
+                                         expected.upper_bound(point + distance));
+                ASSERT_EQ(heh, nearSet.FindNear(point, distance));
+                ASSERT_EQ(heh.size(), nearSet.CountNear(point, distance));
+            }
+        }
+    }
+    // Queued changes stay invisible until published, and the last one wins.
+    nearSet.Add(-5);
+    nearSet.Remove(-5);
+    nearSet.Add(-7);
+    ASSERT_EQ(std::vector<int64_t>{}, nearSet.FindNear(-6, 1));
+    nearSet.Publish();
+    ASSERT_EQ(std::vector<int64_t>{-7}, nearSet.FindNear(-6, 1));
+}
+
+// Every published snapshot holds the 1000 points of one version, so a
+// reader that sees a torn or reclaimed snapshot finds a wrong window.
+TEST(ConcurrentNearSet, ReadersSeeWholeSnapshots) {
+    const int64_t kPoints = 1000;
+    const int kVersions = 100;
+    ConcurrentNearSet nearSet;
+    for (int64_t i = 0; i < kPoints; ++i) {
+        nearSet.Add(i);
+    }
+    nearSet.Publish();
+
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            int64_t last_version = 0;
+            while (!done.load()) {
+                std::vector<int64_t> points = nearSet.FindNear(kPoints * kVersions, kPoints * kVersions);
+                int64_t version = points.empty() ? -1 : points.front() / kPoints;
+                bool whole = points.size() == static_cast<size_t>(kPoints) &&
+                             points.front() == version * kPoints &&
+                             points.back() == version * kPoints + kPoints - 1 &&
+                             version >= last_version;
+                if (!whole) {
+                    ++bad;
+                }
+                last_version = version;
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (int64_t version = 1; version < kVersions; ++version) {
+        for (int64_t i = 0; i < kPoints; ++i) {
+            nearSet.Remove((version - 1) * kPoints + i);
+            nearSet.Add(version * kPoints + i);
+        }
+        nearSet.Publish();
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(0, bad.load());
+}
+
+template <int K>
+void CheckNearSetND(int64_t range, int64_t max_distance) {
+    typedef typename NearSetND<K>::Point Point;
+    std::mt19937_64 generator(K);
+    std::uniform_int_distribution<int64_t> coordinate(0, range);
+    auto random_point = [&] {
+        Point point;
+        for (int i = 0; i < K; ++i) {
+            point[i] = coordinate(generator);
+        }
+        return point;
+    };
+    std::vector<Point> initial;
+    for (int i = 0; i < 5000; ++i) {
+        initial.push_back(random_point());
+    }
+    // Clustered points, so that splits meet many equal coordinates.
+    for (int i = 0; i < 500; ++i) {
+        Point point = random_point();
+        point[0] = 7;
+        initial.push_back(point);
+    }
+    NearSetND<K> nearSet(initial);
+    std::set<Point> expected(initial.begin(), initial.end());
+    ASSERT_EQ(expected.size(), nearSet.Size());
+
+    for (int round = 0; round < 6; ++round) {
+        for (int i = 0; i < 3000; ++i) {
+            Point point = round % 2 == 0 ? random_point() : *std::next(
+                expected.begin(), std::uniform_int_distribution<size_t>(0, expected.size() - 1)(generator));
+            if (round % 2 == 0) {
+                nearSet.Add(point);
+                expected.insert(point);
+            } else {
+                nearSet.Remove(point);
+                expected.erase(point);
+            }
+        }
+        ASSERT_EQ(expected.size(), nearSet.Size());
+        for (int i = 0; i < 100; ++i) {
+            Point point = random_point();
+            int64_t distance = std::uniform_int_distribution<int64_t>(0, max_distance)(generator);
+            std::vector<Point> heh;
+            for (const Point& candidate : expected) {
+                bool near = true;
+                for (int j = 0; j < K; ++j) {
+                    near &= std::abs(candidate[j] - point[j]) <= distance;
+                }
+                if (near) {
+                    heh.push_back(candidate);
+                }
+            }
+            ASSERT_EQ(heh, nearSet.FindNear(point, distance));
+        }
+    }
+}
+
+TEST(NearSetND, MatchesBruteForce) {
+    CheckNearSetND<2>(1000, 100);
+    CheckNearSetND<3>(100, 20);
+}
+
+TEST(NearSetND, Incremental) {
+    NearSetND<2> nearSet;
+    ASSERT_EQ(std::vector<NearSetND<2>::Point>{}, nearSet.FindNear({0, 0}, 5));
+    nearSet.Remove({1, 1});
+    // Sorted inserts along a line are the worst case for the leaf splits.
+    for (int64_t i = 0; i < 20000; ++i) {
+        nearSet.Add({i, -i});
+        nearSet.Add({i, -i});
+    }
+    ASSERT_EQ(20000u, nearSet.Size());
+    ASSERT_EQ((std::vector<NearSetND<2>::Point>{{99, -99}, {100, -100}, {101, -101}}),
+              nearSet.FindNear({100, -100}, 1));
+    for (int64_t i = 0; i < 20000; ++i) {
+        nearSet.Remove({i, -i});
+    }
+    ASSERT_EQ(0u, nearSet.Size());
+
+    const int64_t kMax = std::numeric_limits<int64_t>::max();
+    nearSet.Add({kMax, std::numeric_limits<int64_t>::min()});
+    ASSERT_EQ(1u, nearSet.FindNear({0, -1}, kMax).size());
+    ASSERT_EQ(0u, nearSet.FindNear({0, 0}, kMax).size());
+}
@@ -0,0 +1,90 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mpmc_ring_buffer.h"
+
+// What callers share between threads without MpmcRingBuffer.
+class LockedDeque {
+ public:
+    explicit LockedDeque(size_t capacity) : capacity_(capacity) {}
+
+    bool TryPush(int element) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (buffer_.size() == capacity_) {
+            return false;
+        }
+        buffer_.push_back(element);
+        return true;
+    }
+
+    bool TryPop(int* element) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (buffer_.empty()) {
+            return false;
+        }
+        *element = buffer_.front();
+        buffer_.pop_front();
+        return true;
+    }
+
+ private:
+    std::mutex mutex_;
+    std::deque<int> buffer_;
+    size_t capacity_;
+};
+
+// threads / 2 producers and threads / 2 consumers move `elements`
+// elements through one queue. Returns elements per second.
+template <class Queue>
+double BenchContention(size_t threads_count, size_t elements) {
+    Queue queue(1024);
+    size_t pairs = threads_count / 2;
+    size_t per_producer = elements / pairs;
+    std::atomic<size_t> consumed(0);
+
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < pairs; ++t) {
+        threads.emplace_back([&queue, per_producer] {
+            for (size_t i = 0; i < per_producer;) {
+                if (queue.TryPush(static_cast<int>(i))) {
+                    ++i;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        threads.emplace_back([&queue, &consumed, per_producer, pairs] {
+            int element;
+            while (consumed.load(std::memory_order_relaxed) < per_producer * pairs) {
+                if (queue.TryPop(&element)) {
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return per_producer * pairs / elapsed.count();
+}
+
+int main() {
+    const size_t kElements = 4000000;
+    for (size_t threads = 2; threads <= 64; threads *= 2) {
+        std::cout << "threads " << threads << ": mutex deque "
+                  << static_cast<size_t>(BenchContention<LockedDeque>(threads, kElements))
+                  << " elements/s, mpmc "
+                  << static_cast<size_t>(BenchContention<MpmcRingBuffer<int>>(threads, kElements))
+                  << " elements/s" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "ring_buffer.h"
+
+// The std::deque-backed RingBuffer this header used to contain.
+class DequeRingBuffer {
+ public:
+    explicit DequeRingBuffer(size_t capacity) : capacity_(capacity) {}
+
+    bool TryPush(int element) {
+        if (buffer_.size() + 1 <= capacity_) {
+            buffer_.push_back(element);
+            return true;
+        }
+        return false;
+    }
+
+    bool TryPop(int* element) {
+        if (buffer_.size() > 0) {
+            *element = buffer_.front();
+            buffer_.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+ private:
+    std::deque<int> buffer_;
+    size_t capacity_;
+};
+
+// Pushes `batch` elements, then pops them, until `operations` elements
+// have gone through the buffer. Returns elements per second.
+template <class Buffer>
+double BenchPushPop(size_t capacity, size_t batch, size_t operations) {
+    Buffer buffer(capacity);
+    int element = 0;
+    long long checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < operations; done += batch) {
+        for (size_t i = 0; i < batch; ++i) {
+            buffer.TryPush(static_cast<int>(i));
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            buffer.TryPop(&element);
+            checksum += element;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (checksum == -1) {
+        std::cout << checksum;
+    }
+    return operations / elapsed.count();
+}
+
+// Same traffic as BenchPushPop through TryPushN/TryPopN.
+double BenchPushPopN(size_t capacity, size_t batch, size_t operations) {
+    RingBuffer<int> buffer(capacity);
+    std::vector<int> elements(batch);
+    for (size_t i = 0; i < batch; ++i) {
+        elements[i] = static_cast<int>(i);
+    }
+    std::vector<int> popped(batch);
+    long long checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < operations; done += batch) {
+        buffer.TryPushN(elements);
+        buffer.TryPopN(popped);
+        checksum += popped[batch - 1];
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (checksum == -1) {
+        std::cout << checksum;
+    }
+    return operations / elapsed.count();
+}
+
+int main() {
+    const size_t kOperations = 100000000;
+
+    for (size_t capacity : {16, 1024, 65536}) {
+        for (size_t batch : {size_t(1), capacity / 2, capacity}) {
+            std::cout << "capacity " << capacity << ", batch " << batch << ": deque "
+                      << static_cast<size_t>(BenchPushPop<DequeRingBuffer>(capacity, batch, kOperations))
+                      << " elements/s, ring "
+                      << static_cast<size_t>(BenchPushPop<RingBuffer<int>>(capacity, batch, kOperations))
+                      << " elements/s, ring batched "
+                      << static_cast<size_t>(BenchPushPopN(capacity, batch, kOperations))
+                      << " elements/s" << std::endl;
+        }
+    }
+    return 0;
+}
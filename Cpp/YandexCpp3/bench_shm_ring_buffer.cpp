@@ -0,0 +1,127 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shm_ring_buffer.h"
+
+template <size_t kSize>
+struct Record {
+    char bytes[kSize];
+};
+
+bool WriteAll(int fd, const void* data, size_t size) {
+    const char* from = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, from, size);
+        if (written <= 0) {
+            return false;
+        }
+        from += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool ReadAll(int fd, void* data, size_t size) {
+    char* to = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t got = read(fd, to, size);
+        if (got <= 0) {
+            return false;
+        }
+        to += got;
+        size -= got;
+    }
+    return true;
+}
+
+// A child process sends `records` records in batches of `batch` over a
+// Unix-domain stream socket. Returns records per second.
+template <size_t kSize>
+double BenchSocket(size_t records, size_t batch) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::vector<Record<kSize>> buffer(batch);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[0]);
+        for (size_t sent = 0; sent < records; sent += batch) {
+            WriteAll(fds[1], buffer.data(), batch * kSize);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    for (size_t received = 0; received < records; received += batch) {
+        ReadAll(fds[0], buffer.data(), batch * kSize);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    close(fds[0]);
+    waitpid(child, nullptr, 0);
+    return records / elapsed.count();
+}
+
+// Same traffic through a ShmRingBuffer of 4096 records.
+template <size_t kSize>
+double BenchShm(size_t records, size_t batch) {
+    typedef ShmRingBuffer<Record<kSize>> Ring;
+    std::string name = "/bench_shm_ring_buffer." + std::to_string(getpid());
+    Ring::Unlink(name);
+    Ring::Create(name, 4096);
+    std::vector<Record<kSize>> buffer(batch);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t child = fork();
+    if (child == 0) {
+        Ring producer;
+        producer.Attach(name, Ring::Role::kProducer);
+        for (size_t sent = 0; sent < records;) {
+            size_t pushed = producer.TryPushN(buffer);
+            if (pushed == 0) {
+                sched_yield();
+            }
+            sent += pushed;
+        }
+        producer.Detach();
+        _exit(0);
+    }
+    Ring consumer;
+    consumer.Attach(name, Ring::Role::kConsumer);
+    for (size_t received = 0; received < records;) {
+        size_t popped = consumer.TryPopN(buffer);
+        if (popped == 0) {
+            sched_yield();
+        }
+        received += popped;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    waitpid(child, nullptr, 0);
+    Ring::Unlink(name);
+    return records / elapsed.count();
+}
+
+template <size_t kSize>
+void Bench(size_t records) {
+    for (size_t batch : {1, 64}) {
+        std::cout << "record " << kSize << " bytes, batch " << batch << ": socket "
+                  << static_cast<size_t>(BenchSocket<kSize>(records, batch))
+                  << " records/s, shm "
+                  << static_cast<size_t>(BenchShm<kSize>(records, batch))
+                  << " records/s" << std::endl;
+    }
+}
+
+int main() {
+    const size_t kRecords = 1 << 20;
+    Bench<16>(kRecords);
+    Bench<64>(kRecords);
+    Bench<256>(kRecords);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring_buffer.h"
+
+// The producer stamps every message with the time it was pushed; the
+// consumer measures how long it took to come out the other end.
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Busy-waits, but lets the other side run if it seems to be descheduled
+// (e.g. when both share a core).
+void Backoff(int* spins) {
+    if (++*spins == 1000) {
+        *spins = 0;
+        std::this_thread::yield();
+    }
+}
+
+void BenchHandoff(size_t capacity, size_t messages) {
+    SpscRingBuffer<int64_t> buffer(capacity);
+    std::vector<int64_t> latencies;
+    latencies.reserve(messages);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&buffer, messages] {
+        int spins = 0;
+        for (size_t i = 0; i < messages; ++i) {
+            while (!buffer.TryPush(NowNs())) {
+                Backoff(&spins);
+            }
+        }
+    });
+    int64_t sent_at;
+    int spins = 0;
+    while (latencies.size() < messages) {
+        if (buffer.TryPop(&sent_at)) {
+            latencies.push_back(NowNs() - sent_at);
+        } else {
+            Backoff(&spins);
+        }
+    }
+    producer.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "capacity " << capacity << ": "
+              << static_cast<size_t>(messages / elapsed.count()) << " messages/s, p50 "
+              << latencies[messages / 2] << " ns, p99 "
+              << latencies[messages * 99 / 100] << " ns" << std::endl;
+}
+
+int main() {
+    for (size_t capacity : {64, 1024, 65536}) {
+        BenchHandoff(capacity, 2000000);
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "stack.h"
+
+// The free list as it was used before: a vector behind a mutex.
+class LockedStack {
+ public:
+    void Push(int element) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        container_.push_back(element);
+    }
+
+    bool Pop(int* element) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (container_.empty()) {
+            return false;
+        }
+        *element = container_.back();
+        container_.pop_back();
+        return true;
+    }
+
+ private:
+    std::mutex mutex_;
+    std::vector<int> container_;
+};
+
+// Every thread takes an item off the shared free list and puts it back,
+// `operations` times in total. Returns pop/push pairs per second.
+template <class FreeList>
+double BenchFreeList(size_t threads_count, size_t operations) {
+    FreeList free_list;
+    for (size_t i = 0; i < 1024; ++i) {
+        free_list.Push(static_cast<int>(i));
+    }
+
+    std::vector<std::thread> threads;
+    size_t per_thread = operations / threads_count;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads_count; ++t) {
+        threads.emplace_back([&free_list, per_thread] {
+            int item;
+            for (size_t i = 0; i < per_thread; ++i) {
+                if (free_list.Pop(&item)) {
+                    free_list.Push(item);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return per_thread * threads_count / elapsed.count();
+}
+
+int main() {
+    const size_t kOperations = 8000000;
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+        std::cout << "threads " << threads << ": mutex vector "
+                  << static_cast<size_t>(BenchFreeList<LockedStack>(threads, kOperations))
+                  << " ops/s, lock-free stack "
+                  << static_cast<size_t>(BenchFreeList<Stack<int>>(threads, kOperations))
+                  << " ops/s" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "static_map.h"
+
+// StaticMap as it was: binary search over the sorted pairs.
+class SortedVectorMap {
+ public:
+    explicit SortedVectorMap(const std::vector<std::pair<std::string, std::string>>& items)
+        : items_(items) {
+        std::sort(items_.begin(), items_.end());
+    }
+
+    bool Find(const std::string& key, std::string* value) const {
+        auto it = std::lower_bound(items_.begin(), items_.end(),
+                                   std::make_pair(key, std::string("")));
+        if (it != items_.end() && it->first == key) {
+            *value = it->second;
+            return true;
+        }
+        return false;
+    }
+
+ private:
+    std::vector<std::pair<std::string, std::string>> items_;
+};
+
+// Looks up every query once, `expected` of which are present. Returns
+// lookups per second.
+template <class Map>
+double BenchFind(const Map& map, const std::vector<std::string>& queries, size_t expected) {
+    std::string value;
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& query : queries) {
+        found += map.Find(query, &value);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (found != expected) {
+        std::cout << "found " << found << " keys, expected " << expected << std::endl;
+    }
+    return queries.size() / elapsed.count();
+}
+
+// Queries that the map's Bloom filter rejects on its own.
+size_t ShortCircuited(const StaticMap& map, const std::vector<std::string>& queries) {
+    size_t rejected = 0;
+    for (const auto& query : queries) {
+        rejected += !map.MayContain(query);
+    }
+    return rejected;
+}
+
+int main() {
+    const size_t kQueries = 2000000;
+    std::mt19937 generator(42);
+
+    for (size_t size : {1000, 100000, 1000000, 4000000}) {
+        std::vector<std::pair<std::string, std::string>> items;
+        items.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            items.emplace_back("user:" + std::to_string(i * 7919), std::to_string(i));
+        }
+        std::vector<std::string> queries, misses;
+        queries.reserve(kQueries);
+        misses.reserve(kQueries);
+        std::uniform_int_distribution<size_t> pick(0, size - 1);
+        for (size_t i = 0; i < kQueries; ++i) {
+            queries.push_back(items[pick(generator)].first);
+            misses.push_back("user:" + std::to_string(pick(generator) * 7919 + 1));
+        }
+
+        SortedVectorMap sorted(items);
+        StaticMap hashed(items, StaticMap::Layout::kPerfectHash);
+        StaticMap eytzinger(items, StaticMap::Layout::kEytzinger);
+        std::cout << size << " keys: sorted vector "
+                  << static_cast<size_t>(BenchFind(sorted, queries, kQueries))
+                  << " lookups/s, eytzinger "
+                  << static_cast<size_t>(BenchFind(eytzinger, queries, kQueries))
+                  << " lookups/s, perfect hash "
+                  << static_cast<size_t>(BenchFind(hashed, queries, kQueries))
+                  << " lookups/s" << std::endl;
+
+        // Front-coded keys: smaller images, Find walks up to 8 keys.
+        StaticMap coded_hashed(items, StaticMap::Layout::kPerfectHash, 0,
+                               StaticMap::KeyEncoding::kFrontCoded);
+        StaticMap coded_eytzinger(items, StaticMap::Layout::kEytzinger, 0,
+                                  StaticMap::KeyEncoding::kFrontCoded);
+        std::cout << size << " keys, front-coded: eytzinger "
+                  << static_cast<size_t>(BenchFind(coded_eytzinger, queries, kQueries))
+                  << " lookups/s, perfect hash "
+                  << static_cast<size_t>(BenchFind(coded_hashed, queries, kQueries))
+                  << " lookups/s" << std::endl;
+
+        // Absent keys, with and without a 1% Bloom filter in front.
+        StaticMap filtered_hashed(items, StaticMap::Layout::kPerfectHash, 0.01);
+        StaticMap filtered_eytzinger(items, StaticMap::Layout::kEytzinger, 0.01);
+        std::cout << size << " keys, misses: eytzinger "
+                  << static_cast<size_t>(BenchFind(eytzinger, misses, 0))
+                  << " lookups/s, filtered "
+                  << static_cast<size_t>(BenchFind(filtered_eytzinger, misses, 0))
+                  << " lookups/s, perfect hash "
+                  << static_cast<size_t>(BenchFind(hashed, misses, 0))
+                  << " lookups/s, filtered "
+                  << static_cast<size_t>(BenchFind(filtered_hashed, misses, 0))
+                  << " lookups/s (" << ShortCircuited(filtered_hashed, misses)
+                  << " short-circuited)" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <utility>
+
+#include "event_count.h"
+#include "mpmc_ring_buffer.h"
+
+// Adds blocking Push/Pop to a concurrent ring buffer (MpmcRingBuffer, or
+// SpscRingBuffer when there is one producer and one consumer). A blocked
+// call first spins on the Try version for a while, then sleeps on a futex
+// until the other side makes progress or the timeout runs out. Every
+// successful push or pop through this class wakes the other side; when
+// nobody sleeps that wake is a fence and a load, with no shared write.
+template <class T, template <class> class Buffer = MpmcRingBuffer>
+class BlockingRingBuffer {
+ public:
+    typedef EventCount::Clock Clock;
+    typedef Clock::duration Duration;
+
+    explicit BlockingRingBuffer(size_t capacity) : buffer_(capacity) {}
+
+    size_t Size() const;
+    bool Empty() const;
+    size_t Capacity() const;
+
+    bool TryPush(const T& element);
+    bool TryPush(T&& element);
+    bool TryPop(T* element);
+
+    size_t TryPushN(std::span<const T> elements);
+    size_t TryPopN(std::span<T> elements);
+
+    // Wait as long as it takes.
+    void Push(T element);
+    void Pop(T* element);
+
+    // Return false if the buffer stayed full (empty) for `timeout`.
+    bool Push(T element, Duration timeout);
+    bool Pop(T* element, Duration timeout);
+
+ private:
+    static const int kSpins = 128;
+    static const size_t kCacheLine = 64;
+
+    Buffer<T> buffer_;
+    // Producers notify one and consumers the other on every operation,
+    // so they get a cache line each.
+    alignas(kCacheLine) EventCount not_empty_;
+    alignas(kCacheLine) EventCount not_full_;
+
+    bool push_(T* element, const Clock::time_point* deadline);
+    bool pop_(T* element, const Clock::time_point* deadline);
+
+    template <class TryOnce>
+    static bool wait_(EventCount* event, const Clock::time_point* deadline, TryOnce try_once);
+};
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+template <class T, template <class> class Buffer>
+size_t BlockingRingBuffer<T, Buffer>::Size() const {
+    return buffer_.Size();
+}
+
+template <class T, template <class> class Buffer>
+bool BlockingRingBuffer<T, Buffer>::Empty() const {
+    return buffer_.Empty();
+}
+
+template <class T, template <class> class Buffer>
+size_t BlockingRingBuffer<T, Buffer>::Capacity() const {
+    return buffer_.Capacity();
+}
+
+template <class T, template <class> class Buffer>
+bool BlockingRingBuffer<T, Buffer>::TryPush(const T& element) {
+    if (!buffer_.TryPush(element)) {
+        return false;
+    }
+    not_empty_.NotifyOne();
+    return true;
+}
+
+template <class T, template <class> class Buffer>
+bool BlockingRingBuffer<T, Buffer>::TryPush(T&& element) {
+    if (!buffer_.TryPush(std::move(element))) {
+        return false;
+    }
+    not_empty_.NotifyOne();
+    return true;
+}
+
+template <class T, template <class> class Buffer>
+bool BlockingRingBuffer<T, Buffer>::TryPop(T* element) {
+    if (!buffer_.TryPop(element)) {
+        return false;
+    }
+    not_full_.NotifyOne();
+    return true;
+}
+
+template <class T, template <class> class Buffer>
+size_t BlockingRingBuffer<T, Buffer>::TryPushN(std::span<const T> elements) {
+    size_t count = buffer_.TryPushN(elements);
+    if (count) {
+        not_empty_.NotifyAll();
+    }
+    return count;
+}
+
+template <class T, template <class> class Buffer>
+size_t BlockingRingBuffer<T, Buffer>::TryPopN(std::span<T> elements) {
+    size_t count = buffer_.TryPopN(elements);
+    if (count) {
+        not_full_.NotifyAll();
+    }
+    return count;
+}
+
+template <class T, template <class> class Buffer>
+void BlockingRingBuffer<T, Buffer>::Push(T element) {
+    push_(&element, nullptr);
+}
+
+template <class T, template <class> class Buffer>
+void BlockingRingBuffer<T, Buffer>::Pop(T* element) {
+    pop_(element, nullptr);
+}
+
+template <class T, template <class> class Buffer>
+bool BlockingRingBuffer<T, Buffer>::Push(T element, Duration timeout) {
+    Clock::time_point deadline = Clock::now() + timeout;
+    return push_(&element, &deadline);
+}
+
+template <class T, template <class> class Buffer>
+bool BlockingRingBuffer<T, Buffer>::Pop(T* element, Duration timeout) {
+    Clock::time_point deadline = Clock::now() + timeout;
+    return pop_(element, &deadline);
+}
+
+template <class T, template <class> class Buffer>
+bool BlockingRingBuffer<T, Buffer>::push_(T* element, const Clock::time_point* deadline) {
+    // A failed TryPush leaves the element where it was.
+    return wait_(&not_full_, deadline, [this, element] {
+        return TryPush(std::move(*element));
+    });
+}
+
+template <class T, template <class> class Buffer>
+bool BlockingRingBuffer<T, Buffer>::pop_(T* element, const Clock::time_point* deadline) {
+    return wait_(&not_empty_, deadline, [this, element] {
+        return TryPop(element);
+    });
+}
+
+template <class T, template <class> class Buffer>
+template <class TryOnce>
+bool BlockingRingBuffer<T, Buffer>::wait_(EventCount* event, const Clock::time_point* deadline,
+                                          TryOnce try_once) {
+    for (int spin = 0; spin < kSpins; ++spin) {
+        if (try_once()) {
+            return true;
+        }
+        CpuRelax();
+    }
+    while (true) {
+        uint32_t key = event->PrepareWait();
+        if (try_once()) {
+            event->CancelWait();
+            return true;
+        }
+        if (!event->Wait(key, deadline)) {
+            return try_once();
+        }
+        if (try_once()) {
+            return true;
+        }
+    }
+}
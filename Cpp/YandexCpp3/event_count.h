@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// ThreadSanitizer does not model fences, so under it both sides fall back
+// to ordering through seq_cst read-modify-writes of waiters_.
+#if defined(__SANITIZE_THREAD__)
+#define EVENT_COUNT_TSAN
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define EVENT_COUNT_TSAN
+#endif
+#endif
+
+// Lets threads sleep until "something changed" without a mutex. A waiter
+// announces itself with PrepareWait, re-checks its condition, and only
+// then calls Wait; a notifier changes the state first and then calls
+// Notify. The waiter counts itself in waiters_ and the notifier reads it,
+// each behind a seq_cst fence, and those fences are totally ordered:
+// either the waiter's comes second and its re-check sees the new state,
+// or the notifier's comes second and it sees the waiter, so no wakeup is
+// lost. When nobody is waiting Notify is that fence and a plain load, so
+// it writes to no shared cache line; the futex syscall is only made when
+// waiters_ is non-zero.
+class EventCount {
+ public:
+    typedef std::chrono::steady_clock Clock;
+
+    uint32_t PrepareWait() {
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+#ifndef EVENT_COUNT_TSAN
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    // The condition became true after PrepareWait: don't sleep.
+    void CancelWait() {
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Sleeps until a Notify after the matching PrepareWait or until
+    // deadline (never when it is null). Returns false on timeout.
+    // Spurious wakeups are possible, so re-check the condition.
+    bool Wait(uint32_t key, const Clock::time_point* deadline) {
+        timespec until;
+        if (deadline) {
+            auto since_epoch = deadline->time_since_epoch();
+            auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+            until.tv_sec = seconds.count();
+            until.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                since_epoch - seconds).count();
+        }
+        // steady_clock is CLOCK_MONOTONIC, which is what FUTEX_WAIT_BITSET
+        // measures absolute timeouts against.
+        long result = syscall(SYS_futex, &epoch_, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+                              key, deadline ? &until : nullptr, nullptr, FUTEX_BITSET_MATCH_ANY);
+        bool timed_out = result == -1 && errno == ETIMEDOUT;
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return !timed_out;
+    }
+
+    void NotifyOne() {
+        notify_(1);
+    }
+
+    void NotifyAll() {
+        notify_(INT_MAX);
+    }
+
+ private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                  "futex needs a plain 32-bit word");
+
+    std::atomic<uint32_t> epoch_{0};
+    std::atomic<uint32_t> waiters_{0};
+
+    void notify_(int count) {
+#ifdef EVENT_COUNT_TSAN
+        if (waiters_.fetch_add(0, std::memory_order_seq_cst) == 0) {
+            return;
+        }
+#else
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+#endif
+        epoch_.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, &epoch_, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, count, nullptr, nullptr, 0);
+    }
+};
@@ -0,0 +1,256 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Lock-free bounded queue for any number of producers and consumers with
+// RingBuffer's TryPush/TryPop contract (Dmitry Vyukov's algorithm).
+// Every slot carries a sequence number that says whose turn it is: a slot
+// at position p is free for the producer claiming p when its sequence is
+// p, and holds an element for the consumer claiming p when it is p + 1.
+// Producers and consumers claim positions with a CAS on their own index
+// and hand the slot over with a release store of its sequence, so the two
+// sides never contend on the same counter.
+// The cells are rounded up to a power of two, and to at least two: with
+// one cell, a popped slot's sequence would read as full for the next lap.
+// A push also checks the consumers' index, so the buffer holds exactly
+// `capacity` elements, as RingBuffer and SpscRingBuffer do.
+template <class T = int>
+class MpmcRingBuffer {
+ public:
+    explicit MpmcRingBuffer(size_t capacity);
+    ~MpmcRingBuffer();
+
+    MpmcRingBuffer(const MpmcRingBuffer&) = delete;
+    MpmcRingBuffer& operator=(const MpmcRingBuffer&) = delete;
+
+    // Exact only when no thread is pushing or popping.
+    size_t Size() const;
+    bool Empty() const;
+    size_t Capacity() const;
+
+    bool TryPush(const T& element);
+    bool TryPush(T&& element);
+
+    template <class... Args>
+    bool TryEmplace(Args&&... args);
+
+    bool TryPop(T* element);
+
+    // Claim a run of consecutive ready slots with a single CAS of the
+    // index, so a batch costs one contended update instead of one per
+    // element. Elements still go through their own cells: the sequence
+    // words sit between them, so there is no contiguous run to memcpy.
+    size_t TryPushN(std::span<const T> elements);
+    size_t TryPopN(std::span<T> elements);
+
+ private:
+    static const size_t kCacheLine = 64;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T* element() {
+            return reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    std::unique_ptr<Cell[]> buffer_;
+    size_t mask_;
+    size_t capacity_;
+
+    // Room left for pushes from `position`.
+    size_t room_(size_t position) const;
+
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+    alignas(kCacheLine) std::atomic<size_t> head_{0};
+};
+
+template <class T>
+MpmcRingBuffer<T>::MpmcRingBuffer(size_t capacity) {
+    size_t length = 2;
+    while (length < capacity) {
+        length *= 2;
+    }
+    buffer_.reset(new Cell[length]);
+    for (size_t i = 0; i < length; ++i) {
+        buffer_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask_ = length - 1;
+    capacity_ = capacity;
+}
+
+template <class T>
+MpmcRingBuffer<T>::~MpmcRingBuffer() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    for (size_t head = head_.load(std::memory_order_relaxed); head != tail; ++head) {
+        buffer_[head & mask_].element()->~T();
+    }
+}
+
+template <class T>
+size_t MpmcRingBuffer<T>::Size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+}
+
+template <class T>
+bool MpmcRingBuffer<T>::Empty() const {
+    return Size() == 0;
+}
+
+template <class T>
+size_t MpmcRingBuffer<T>::Capacity() const {
+    return capacity_;
+}
+
+template <class T>
+bool MpmcRingBuffer<T>::TryPush(const T& element) {
+    return TryEmplace(element);
+}
+
+template <class T>
+bool MpmcRingBuffer<T>::TryPush(T&& element) {
+    return TryEmplace(std::move(element));
+}
+
+template <class T>
+template <class... Args>
+bool MpmcRingBuffer<T>::TryEmplace(Args&&... args) {
+    size_t position = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &buffer_[position & mask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        ptrdiff_t turn = static_cast<ptrdiff_t>(sequence - position);
+        if (turn == 0) {
+            if (room_(position) == 0) {
+                return false;
+            }
+            if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (turn < 0) {
+            // The slot still holds the element from one lap ago: full.
+            return false;
+        } else {
+            position = tail_.load(std::memory_order_relaxed);
+        }
+    }
+    new (cell->element()) T(std::forward<Args>(args)...);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+template <class T>
+bool MpmcRingBuffer<T>::TryPop(T* element) {
+    size_t position = head_.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &buffer_[position & mask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        ptrdiff_t turn = static_cast<ptrdiff_t>(sequence - (position + 1));
+        if (turn == 0) {
+            if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (turn < 0) {
+            // Nothing has been pushed into this slot yet: empty.
+            return false;
+        } else {
+            position = head_.load(std::memory_order_relaxed);
+        }
+    }
+    T* slot = cell->element();
+    *element = std::move(*slot);
+    slot->~T();
+    cell->sequence.store(position + mask_ + 1, std::memory_order_release);
+    return true;
+}
+
+template <class T>
+size_t MpmcRingBuffer<T>::TryPushN(std::span<const T> elements) {
+    if (elements.empty()) {
+        return 0;
+    }
+    size_t position = tail_.load(std::memory_order_relaxed);
+    size_t count;
+    while (true) {
+        size_t limit = std::min(elements.size(), room_(position));
+        count = 0;
+        while (count < limit &&
+               buffer_[(position + count) & mask_].sequence.load(std::memory_order_acquire) ==
+                   position + count) {
+            ++count;
+        }
+        if (count == 0) {
+            size_t sequence = buffer_[position & mask_].sequence.load(std::memory_order_acquire);
+            if (limit == 0 || static_cast<ptrdiff_t>(sequence - position) < 0) {
+                return 0;
+            }
+            position = tail_.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (tail_.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Cell& cell = buffer_[(position + i) & mask_];
+        new (cell.element()) T(elements[i]);
+        cell.sequence.store(position + i + 1, std::memory_order_release);
+    }
+    return count;
+}
+
+template <class T>
+size_t MpmcRingBuffer<T>::TryPopN(std::span<T> elements) {
+    if (elements.empty()) {
+        return 0;
+    }
+    size_t position = head_.load(std::memory_order_relaxed);
+    size_t count;
+    while (true) {
+        count = 0;
+        while (count < elements.size() &&
+               buffer_[(position + count) & mask_].sequence.load(std::memory_order_acquire) ==
+                   position + count + 1) {
+            ++count;
+        }
+        if (count == 0) {
+            size_t sequence = buffer_[position & mask_].sequence.load(std::memory_order_acquire);
+            if (static_cast<ptrdiff_t>(sequence - (position + 1)) < 0) {
+                return 0;
+            }
+            position = head_.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (head_.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Cell& cell = buffer_[(position + i) & mask_];
+        T* slot = cell.element();
+        elements[i] = std::move(*slot);
+        slot->~T();
+        cell.sequence.store(position + i + mask_ + 1, std::memory_order_release);
+    }
+    return count;
+}
+
+// The head may be stale, which only understates the room: a push can fail
+// while a pop is in flight, but never overfills.
+template <class T>
+size_t MpmcRingBuffer<T>::room_(size_t position) const {
+    size_t used = position - head_.load(std::memory_order_acquire);
+    return used < capacity_ ? capacity_ - used : 0;
+}
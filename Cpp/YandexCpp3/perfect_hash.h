@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <vector>
+
+// Seeded 64-bit hash of a byte string, eight bytes per step.
+inline uint64_t HashString(std::string_view key, uint64_t seed) {
+    const uint64_t kMultiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = seed ^ (key.size() * kMultiplier);
+    size_t i = 0;
+    for (; i + 8 <= key.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, key.data() + i, 8);
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 31;
+    }
+    if (i < key.size()) {
+        uint64_t word = 0;
+        std::memcpy(&word, key.data() + i, key.size() - i);
+        hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+        hash ^= hash >> 31;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Universal hash of 64-bit values: (seed * x + shift) mod p scaled down to
+// [0, size), with the Mersenne prime p = 2^61 - 1.
+class HashFunction {
+ public:
+    static constexpr uint64_t kPrime = (uint64_t(1) << 61) - 1;
+
+    HashFunction() {}
+
+    HashFunction(uint64_t seed, uint64_t shift, uint64_t size)
+        : seed_(seed), shift_(shift), size_(size) {}
+
+    // Both reductions avoid division: mod p folds the bits above 61 back
+    // in, and the result in [0, p) is scaled to [0, size) with a multiply.
+    uint64_t operator()(uint64_t element) const {
+        element = Reduce(element);
+        unsigned __int128 product = (unsigned __int128)seed_ * element + shift_;
+        uint64_t reduced = (uint64_t)(product & kPrime) + (uint64_t)(product >> 61);
+        reduced = (reduced & kPrime) + (reduced >> 61);
+        if (reduced >= kPrime) {
+            reduced -= kPrime;
+        }
+        return (uint64_t)(((unsigned __int128)(reduced << 3) * size_) >> 64);
+    }
+
+    // x mod p.
+    static uint64_t Reduce(uint64_t x) {
+        x = (x & kPrime) + (x >> 61);
+        return x >= kPrime ? x - kPrime : x;
+    }
+
+    uint64_t GetSize() const {
+        return size_;
+    }
+
+    static HashFunction Generate(uint64_t size, std::mt19937_64& generator) {
+        uint64_t seed = std::uniform_int_distribution<uint64_t>(1, kPrime - 1)(generator);
+        uint64_t shift = std::uniform_int_distribution<uint64_t>(0, kPrime - 1)(generator);
+        return HashFunction(seed, shift, size);
+    }
+
+ private:
+    uint64_t seed_ = 1;
+    uint64_t shift_ = 0;
+    uint64_t size_ = 1;
+};
+
+// Two-level FKS perfect hashing of string keys, as FixedSet in
+// Algo/Contest3/FixedHashSet.h does for ints: keys are first hashed to 64
+// bits, the first level spreads them over n buckets, and a bucket of k keys
+// gets its own collision-free function into k^2 slots. Every key lands in
+// its own slot of [0, SlotCount()), and a lookup is one string hash plus
+// two universal hashes, whatever the keys are.
+class PerfectHash {
+ public:
+    static constexpr size_t kNoSlot = SIZE_MAX;
+
+    // Everything a lookup needs is plain data in a Header and an array of
+    // Buckets, so both can be written to a file and used from an mmap.
+    struct Bucket {
+        HashFunction hash_function;
+        uint64_t offset = 0;
+    };
+
+    struct Header {
+        uint64_t seed = 0;
+        HashFunction hash_function;
+        uint64_t bucket_count = 0;
+        uint64_t slot_count = 0;
+    };
+
+    PerfectHash() {}
+
+    // Keys must be distinct. Building is deterministic for the same keys.
+    void Initialize(const std::vector<std::string_view>& keys);
+
+    // The slot of `key` if it is one of the keys; an arbitrary slot or
+    // kNoSlot otherwise, so the caller still has to compare keys.
+    size_t Slot(std::string_view key) const {
+        return Slot(header_, buckets_.data(), key);
+    }
+
+    static size_t Slot(const Header& header, const Bucket* buckets, std::string_view key);
+
+    size_t SlotCount() const {
+        return header_.slot_count;
+    }
+
+    const Header& GetHeader() const {
+        return header_;
+    }
+
+    const std::vector<Bucket>& GetBuckets() const {
+        return buckets_;
+    }
+
+ private:
+    // Sum of squared bucket sizes allowed per key. The expectation is
+    // below 2, so a random first-level function passes at least half of
+    // the time.
+    static constexpr uint64_t kDispersion = 4;
+
+    Header header_;
+    std::vector<Bucket> buckets_;
+
+    bool TryInitialize(const std::vector<std::string_view>& keys, std::mt19937_64& generator);
+
+    static bool PickUpBucketFunction(const std::vector<uint64_t>& hashes,
+                                     std::mt19937_64& generator, HashFunction* hash_function);
+};
+
+inline void PerfectHash::Initialize(const std::vector<std::string_view>& keys) {
+    std::mt19937_64 generator(42);
+    while (!TryInitialize(keys, generator)) {
+    }
+}
+
+inline size_t PerfectHash::Slot(const Header& header, const Bucket* buckets,
+                                std::string_view key) {
+    if (header.bucket_count == 0) {
+        return kNoSlot;
+    }
+    uint64_t hash = HashString(key, header.seed);
+    const Bucket& bucket = buckets[header.hash_function(hash)];
+    if (bucket.hash_function.GetSize() == 0) {
+        return kNoSlot;
+    }
+    return bucket.offset + bucket.hash_function(hash);
+}
+
+inline bool PerfectHash::TryInitialize(const std::vector<std::string_view>& keys,
+                                       std::mt19937_64& generator) {
+    header_ = Header();
+    buckets_.clear();
+    if (keys.empty()) {
+        return true;
+    }
+    header_.seed = generator();
+    std::vector<uint64_t> hashes;
+    hashes.reserve(keys.size());
+    for (std::string_view key : keys) {
+        hashes.push_back(HashString(key, header_.seed));
+    }
+
+    std::vector<uint64_t> bucket_sizes;
+    do {
+        header_.hash_function = HashFunction::Generate(keys.size(), generator);
+        bucket_sizes.assign(keys.size(), 0);
+        for (uint64_t hash : hashes) {
+            ++bucket_sizes[header_.hash_function(hash)];
+        }
+        uint64_t second_moment = 0;
+        for (uint64_t size : bucket_sizes) {
+            second_moment += size * size;
+        }
+        if (second_moment <= kDispersion * keys.size()) {
+            break;
+        }
+    } while (true);
+
+    std::vector<std::vector<uint64_t>> bucket_hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        bucket_hashes[i].reserve(bucket_sizes[i]);
+    }
+    for (uint64_t hash : hashes) {
+        bucket_hashes[header_.hash_function(hash)].push_back(hash);
+    }
+
+    header_.bucket_count = keys.size();
+    buckets_.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        buckets_[i].offset = header_.slot_count;
+        if (bucket_hashes[i].empty()) {
+            buckets_[i].hash_function = HashFunction(1, 0, 0);
+            continue;
+        }
+        if (!PickUpBucketFunction(bucket_hashes[i], generator, &buckets_[i].hash_function)) {
+            // Two keys hash to the same value mod p: start over with
+            // another seed.
+            return false;
+        }
+        header_.slot_count += buckets_[i].hash_function.GetSize();
+    }
+    return true;
+}
+
+inline bool PerfectHash::PickUpBucketFunction(const std::vector<uint64_t>& hashes,
+                                              std::mt19937_64& generator,
+                                              HashFunction* hash_function) {
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        for (size_t j = i + 1; j < hashes.size(); ++j) {
+            if (HashFunction::Reduce(hashes[i]) == HashFunction::Reduce(hashes[j])) {
+                return false;
+            }
+        }
+    }
+    uint64_t size = hashes.size() * hashes.size();
+    std::vector<bool> taken(size);
+    while (true) {
+        *hash_function = HashFunction::Generate(size, generator);
+        taken.assign(size, false);
+        bool collision = false;
+        for (uint64_t hash : hashes) {
+            uint64_t slot = (*hash_function)(hash);
+            if (taken[slot]) {
+                collision = true;
+                break;
+            }
+            taken[slot] = true;
+        }
+        if (!collision) {
+            return true;
+        }
+    }
+}
@@ -1,47 +1,147 @@
 #pragma once
-#include <iostream>
-#include <deque>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "ring_copy.h"
+
+// Fixed-capacity FIFO over one preallocated array. The array length is
+// rounded up to a power of two so that positions wrap with a mask; head_
+// and tail_ only ever grow, and their difference is the size.
+template <class T = int>
 class RingBuffer {
  public:
     explicit RingBuffer(size_t capacity);
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
 
     size_t Size() const;
     bool Empty() const;
+    size_t Capacity() const;
+
+    bool TryPush(const T& element);
+    bool TryPush(T&& element);
 
-    bool TryPush(int element);
+    // Constructs the element in place from args.
+    template <class... Args>
+    bool TryEmplace(Args&&... args);
 
-    bool TryPop(int* element);
+    bool TryPop(T* element);
+
+    // Move as many elements as fit (or are there) and return how many.
+    // The batch covers at most two contiguous runs of the array, which
+    // are copied with memcpy when T is trivially copyable. If a copy or
+    // move throws, the buffer is left as it was.
+    size_t TryPushN(std::span<const T> elements);
+    size_t TryPopN(std::span<T> elements);
 
  private:
-    std::deque<int> buffer_;
-    int capacity_;
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+
+    std::unique_ptr<Slot[]> buffer_;
+    size_t capacity_;
+    size_t mask_;
+    size_t head_ = 0;
+    size_t tail_ = 0;
+
+    T* slot_(size_t position);
 };
 
-RingBuffer::RingBuffer(size_t capacity) {
+template <class T>
+RingBuffer<T>::RingBuffer(size_t capacity) {
+    size_t length = 1;
+    while (length < capacity) {
+        length *= 2;
+    }
+    buffer_.reset(new Slot[length]);
     capacity_ = capacity;
+    mask_ = length - 1;
+}
+
+template <class T>
+RingBuffer<T>::~RingBuffer() {
+    for (; head_ != tail_; ++head_) {
+        slot_(head_)->~T();
+    }
+}
+
+template <class T>
+size_t RingBuffer<T>::Size() const {
+    return tail_ - head_;
 }
 
-size_t RingBuffer::Size() const {
-    return buffer_.size();
+template <class T>
+bool RingBuffer<T>::Empty() const {
+    return head_ == tail_;
+}
+
+template <class T>
+size_t RingBuffer<T>::Capacity() const {
+    return capacity_;
+}
+
+template <class T>
+bool RingBuffer<T>::TryPush(const T& element) {
+    return TryEmplace(element);
+}
+
+template <class T>
+bool RingBuffer<T>::TryPush(T&& element) {
+    return TryEmplace(std::move(element));
+}
+
+template <class T>
+template <class... Args>
+bool RingBuffer<T>::TryEmplace(Args&&... args) {
+    if (tail_ - head_ == capacity_) {
+        return false;
+    }
+    new (slot_(tail_)) T(std::forward<Args>(args)...);
+    ++tail_;
+    return true;
+}
+
+template <class T>
+bool RingBuffer<T>::TryPop(T* element) {
+    if (head_ == tail_) {
+        return false;
+    }
+    T* slot = slot_(head_);
+    *element = std::move(*slot);
+    slot->~T();
+    ++head_;
+    return true;
 }
 
-bool RingBuffer::Empty() const {
-    return buffer_.empty();
+template <class T>
+T* RingBuffer<T>::slot_(size_t position) {
+    return reinterpret_cast<T*>(&buffer_[position & mask_]);
 }
 
-bool RingBuffer::TryPush(int element) {
-    if (buffer_.size() + 1 <= capacity_) {
-        buffer_.push_back(element);
-        return true;
+template <class T>
+size_t RingBuffer<T>::TryPushN(std::span<const T> elements) {
+    size_t count = std::min(elements.size(), capacity_ - (tail_ - head_));
+    if (count == 0) {
+        return 0;
     }
-    return false;
+    RingCopyIn(slot_(0), mask_, tail_, elements.data(), count);
+    tail_ += count;
+    return count;
 }
 
-bool RingBuffer::TryPop(int *element) {
-    if (buffer_.size() > 0) {
-        (*element) = buffer_.front();
-        buffer_.pop_front();
-        return true;
+template <class T>
+size_t RingBuffer<T>::TryPopN(std::span<T> elements) {
+    size_t count = std::min(elements.size(), tail_ - head_);
+    if (count == 0) {
+        return 0;
     }
-    return false;
+    RingMoveOut(slot_(0), mask_, head_, elements.data(), count);
+    head_ += count;
+    return count;
 }
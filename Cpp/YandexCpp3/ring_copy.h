@@ -0,0 +1,55 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+// Batch copies between a caller's array and the slots of a ring whose
+// length is mask + 1, a power of two. A run starting at `position` wraps
+// around the end of the ring at most once, so it is at most two
+// contiguous copies, done with memcpy when T is trivially copyable.
+// Shared by RingBuffer, SpscRingBuffer and ShmRingBuffer.
+
+// Constructs `count` elements in the (uninitialized) slots from `from`.
+// If a copy throws, the elements already constructed are destroyed, so
+// the slots are left as they were.
+template <class T>
+void RingCopyIn(T* slots, size_t mask, size_t position, const T* from, size_t count) {
+    size_t offset = position & mask;
+    size_t first = std::min(count, mask + 1 - offset);
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        std::memcpy(slots + offset, from, first * sizeof(T));
+        if (count > first) {
+            std::memcpy(slots, from + first, (count - first) * sizeof(T));
+        }
+    } else {
+        std::uninitialized_copy_n(from, first, slots + offset);
+        try {
+            std::uninitialized_copy_n(from + first, count - first, slots);
+        } catch (...) {
+            std::destroy_n(slots + offset, first);
+            throw;
+        }
+    }
+}
+
+// Moves `count` elements out to `to` and destroys them in the slots.
+// Nothing is destroyed until every move is done, so a throwing move
+// leaves all `count` elements in the slots.
+template <class T>
+void RingMoveOut(T* slots, size_t mask, size_t position, T* to, size_t count) {
+    size_t offset = position & mask;
+    size_t first = std::min(count, mask + 1 - offset);
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        std::memcpy(to, slots + offset, first * sizeof(T));
+        if (count > first) {
+            std::memcpy(to + first, slots, (count - first) * sizeof(T));
+        }
+    } else {
+        std::move(slots + offset, slots + offset + first, to);
+        std::move(slots, slots + (count - first), to + first);
+        std::destroy_n(slots + offset, first);
+        std::destroy_n(slots, count - first);
+    }
+}
@@ -0,0 +1,316 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ring_copy.h"
+
+enum class ShmRole {
+    kProducer,
+    kConsumer
+};
+
+// SpscRingBuffer whose slots and indices live in a POSIX shared memory
+// segment, so the producer and the consumer may be different processes.
+// Elements are copied byte for byte and must be trivially copyable.
+//
+// Create makes a named segment, and each process then Attaches to it as
+// the producer or the consumer. A side is owned by the pid stored in the
+// segment: Attach fails while that process is alive and takes the side
+// over once it has died, so a crashed peer can be restarted without
+// recreating the segment. Indices only move after the slot is fully
+// written (or read), so a producer that dies mid-push loses nothing that
+// was published, and a consumer that dies mid-pop sees that element again.
+template <class T>
+class ShmRingBuffer {
+ public:
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "elements are shared as raw bytes");
+
+    typedef ShmRole Role;
+
+    ShmRingBuffer() = default;
+    ~ShmRingBuffer();
+
+    ShmRingBuffer(const ShmRingBuffer&) = delete;
+    ShmRingBuffer& operator=(const ShmRingBuffer&) = delete;
+
+    // `name` is a shm_open name such as "/records". Fails if the segment
+    // already exists.
+    static bool Create(const std::string& name, size_t capacity);
+    static bool Unlink(const std::string& name);
+
+    // Fails if the segment is missing, is not (yet) a ring of T, or the
+    // role is held by a live process.
+    bool Attach(const std::string& name, Role role);
+    // Gives up the role and unmaps the segment. Also done by the destructor.
+    void Detach();
+
+    bool Attached() const;
+
+    // Exact only when neither side is running.
+    size_t Size() const;
+    bool Empty() const;
+    size_t Capacity() const;
+
+    // Producer side. Push nothing unless attached as the producer.
+    bool TryPush(const T& element);
+    size_t TryPushN(std::span<const T> elements);
+
+    // Consumer side. Pop nothing unless attached as the consumer.
+    bool TryPop(T* element);
+    size_t TryPopN(std::span<T> elements);
+
+ private:
+    static const uint32_t kMagic = 0x53524e47;
+    static const uint32_t kVersion = 1;
+    static const size_t kCacheLine = 64;
+
+    // Pointers inside the segment would differ between processes, so
+    // everything here is plain data and address-free atomics.
+    struct Header {
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        uint64_t element_size;
+        uint64_t capacity;
+        uint64_t length;
+        std::atomic<int32_t> owners[2];
+
+        alignas(kCacheLine) std::atomic<uint64_t> head;
+        alignas(kCacheLine) std::atomic<uint64_t> tail;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                  "shared atomics must not hide a process-local lock");
+
+    Header* header_ = nullptr;
+    T* slots_ = nullptr;
+    size_t mapped_size_ = 0;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    Role role_ = Role::kProducer;
+
+    // This process's copy of the other side's index.
+    uint64_t cached_head_ = 0;
+    uint64_t cached_tail_ = 0;
+
+    static size_t slots_offset_();
+    static size_t length_(size_t capacity);
+    static bool alive_(int32_t pid);
+
+    bool claim_(Role role);
+};
+
+template <class T>
+ShmRingBuffer<T>::~ShmRingBuffer() {
+    Detach();
+}
+
+template <class T>
+bool ShmRingBuffer<T>::Create(const std::string& name, size_t capacity) {
+    if (capacity == 0) {
+        return false;
+    }
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        return false;
+    }
+    size_t length = length_(capacity);
+    size_t size = slots_offset_() + length * sizeof(T);
+    void* data = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+    // ftruncate zero-filled the segment; magic goes last so that Attach
+    // never sees a half-initialized header.
+    Header* header = static_cast<Header*>(data);
+    header->version = kVersion;
+    header->element_size = sizeof(T);
+    header->capacity = capacity;
+    header->length = length;
+    header->magic.store(kMagic, std::memory_order_release);
+    munmap(data, size);
+    return true;
+}
+
+template <class T>
+bool ShmRingBuffer<T>::Unlink(const std::string& name) {
+    return shm_unlink(name.c_str()) == 0;
+}
+
+template <class T>
+bool ShmRingBuffer<T>::Attach(const std::string& name, Role role) {
+    if (Attached()) {
+        return false;
+    }
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < slots_offset_()) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    Header* header = static_cast<Header*>(data);
+    if (header->magic.load(std::memory_order_acquire) != kMagic ||
+        header->version != kVersion || header->element_size != sizeof(T) ||
+        header->length != length_(header->capacity) ||
+        size != slots_offset_() + header->length * sizeof(T)) {
+        munmap(data, size);
+        return false;
+    }
+    header_ = header;
+    slots_ = reinterpret_cast<T*>(static_cast<char*>(data) + slots_offset_());
+    mapped_size_ = size;
+    if (!claim_(role)) {
+        header_ = nullptr;
+        slots_ = nullptr;
+        munmap(data, size);
+        return false;
+    }
+    role_ = role;
+    capacity_ = header->capacity;
+    mask_ = header->length - 1;
+    cached_head_ = header->head.load(std::memory_order_acquire);
+    cached_tail_ = header->tail.load(std::memory_order_acquire);
+    return true;
+}
+
+template <class T>
+void ShmRingBuffer<T>::Detach() {
+    if (!Attached()) {
+        return;
+    }
+    int32_t self = getpid();
+    header_->owners[static_cast<int>(role_)].compare_exchange_strong(self, 0);
+    munmap(header_, mapped_size_);
+    header_ = nullptr;
+    slots_ = nullptr;
+}
+
+template <class T>
+bool ShmRingBuffer<T>::Attached() const {
+    return header_ != nullptr;
+}
+
+template <class T>
+size_t ShmRingBuffer<T>::Size() const {
+    return header_->tail.load(std::memory_order_acquire) -
+           header_->head.load(std::memory_order_acquire);
+}
+
+template <class T>
+bool ShmRingBuffer<T>::Empty() const {
+    return Size() == 0;
+}
+
+template <class T>
+size_t ShmRingBuffer<T>::Capacity() const {
+    return capacity_;
+}
+
+template <class T>
+bool ShmRingBuffer<T>::TryPush(const T& element) {
+    return TryPushN(std::span<const T>(&element, 1)) == 1;
+}
+
+template <class T>
+size_t ShmRingBuffer<T>::TryPushN(std::span<const T> elements) {
+    if (!Attached() || role_ != Role::kProducer) {
+        return 0;
+    }
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    if (capacity_ - (tail - cached_head_) < elements.size()) {
+        cached_head_ = header_->head.load(std::memory_order_acquire);
+    }
+    size_t count = std::min<size_t>(elements.size(), capacity_ - (tail - cached_head_));
+    if (count == 0) {
+        return 0;
+    }
+    RingCopyIn(slots_, mask_, tail, elements.data(), count);
+    header_->tail.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+template <class T>
+bool ShmRingBuffer<T>::TryPop(T* element) {
+    return TryPopN(std::span<T>(element, 1)) == 1;
+}
+
+template <class T>
+size_t ShmRingBuffer<T>::TryPopN(std::span<T> elements) {
+    if (!Attached() || role_ != Role::kConsumer) {
+        return 0;
+    }
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < elements.size()) {
+        cached_tail_ = header_->tail.load(std::memory_order_acquire);
+    }
+    size_t count = std::min<size_t>(elements.size(), cached_tail_ - head);
+    if (count == 0) {
+        return 0;
+    }
+    RingMoveOut(slots_, mask_, head, elements.data(), count);
+    header_->head.store(head + count, std::memory_order_release);
+    return count;
+}
+
+template <class T>
+size_t ShmRingBuffer<T>::slots_offset_() {
+    size_t align = std::max(kCacheLine, alignof(T));
+    return (sizeof(Header) + align - 1) / align * align;
+}
+
+template <class T>
+size_t ShmRingBuffer<T>::length_(size_t capacity) {
+    size_t length = 1;
+    while (length < capacity) {
+        length *= 2;
+    }
+    return length;
+}
+
+// A recycled pid looks alive; the side then stays taken until that
+// process exits too.
+template <class T>
+bool ShmRingBuffer<T>::alive_(int32_t pid) {
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+template <class T>
+bool ShmRingBuffer<T>::claim_(Role role) {
+    std::atomic<int32_t>& owner = header_->owners[static_cast<int>(role)];
+    int32_t self = getpid();
+    int32_t current = owner.load(std::memory_order_acquire);
+    while (true) {
+        if (current == self || (current != 0 && alive_(current))) {
+            return false;
+        }
+        if (owner.compare_exchange_weak(current, self, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "ring_copy.h"
+
+// Wait-free RingBuffer for exactly one producer thread (TryPush,
+// TryEmplace) and one consumer thread (TryPop). Each side owns one index
+// and only reads the other's: the producer publishes an element with a
+// release store of tail_, the consumer frees a slot with a release store
+// of head_. The indices live on separate cache lines, and each side keeps
+// a cached copy of the other's index so that it only touches the shared
+// line when the cached value says the buffer is full (or empty).
+template <class T = int>
+class SpscRingBuffer {
+ public:
+    explicit SpscRingBuffer(size_t capacity);
+    ~SpscRingBuffer();
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Exact only when neither side is running.
+    size_t Size() const;
+    bool Empty() const;
+    size_t Capacity() const;
+
+    // Producer side.
+    bool TryPush(const T& element);
+    bool TryPush(T&& element);
+
+    template <class... Args>
+    bool TryEmplace(Args&&... args);
+
+    // Producer side. Same as RingBuffer::TryPushN; the whole batch
+    // becomes visible to the consumer with one store of tail_.
+    size_t TryPushN(std::span<const T> elements);
+
+    // Consumer side.
+    bool TryPop(T* element);
+    size_t TryPopN(std::span<T> elements);
+
+ private:
+    static const size_t kCacheLine = 64;
+
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Slot;
+
+    std::unique_ptr<Slot[]> buffer_;
+    size_t capacity_;
+    size_t mask_;
+
+    // Written by the consumer.
+    alignas(kCacheLine) std::atomic<size_t> head_{0};
+    size_t cached_tail_ = 0;
+
+    // Written by the producer.
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+    size_t cached_head_ = 0;
+
+    T* slot_(size_t position);
+};
+
+template <class T>
+SpscRingBuffer<T>::SpscRingBuffer(size_t capacity) {
+    size_t length = 1;
+    while (length < capacity) {
+        length *= 2;
+    }
+    buffer_.reset(new Slot[length]);
+    capacity_ = capacity;
+    mask_ = length - 1;
+}
+
+template <class T>
+SpscRingBuffer<T>::~SpscRingBuffer() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    for (size_t head = head_.load(std::memory_order_relaxed); head != tail; ++head) {
+        slot_(head)->~T();
+    }
+}
+
+template <class T>
+size_t SpscRingBuffer<T>::Size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+}
+
+template <class T>
+bool SpscRingBuffer<T>::Empty() const {
+    return Size() == 0;
+}
+
+template <class T>
+size_t SpscRingBuffer<T>::Capacity() const {
+    return capacity_;
+}
+
+template <class T>
+bool SpscRingBuffer<T>::TryPush(const T& element) {
+    return TryEmplace(element);
+}
+
+template <class T>
+bool SpscRingBuffer<T>::TryPush(T&& element) {
+    return TryEmplace(std::move(element));
+}
+
+template <class T>
+template <class... Args>
+bool SpscRingBuffer<T>::TryEmplace(Args&&... args) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == capacity_) {
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if (tail - cached_head_ == capacity_) {
+            return false;
+        }
+    }
+    new (slot_(tail)) T(std::forward<Args>(args)...);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template <class T>
+bool SpscRingBuffer<T>::TryPop(T* element) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if (head == cached_tail_) {
+            return false;
+        }
+    }
+    T* slot = slot_(head);
+    *element = std::move(*slot);
+    slot->~T();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+template <class T>
+size_t SpscRingBuffer<T>::TryPushN(std::span<const T> elements) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (capacity_ - (tail - cached_head_) < elements.size()) {
+        cached_head_ = head_.load(std::memory_order_acquire);
+    }
+    size_t count = std::min(elements.size(), capacity_ - (tail - cached_head_));
+    if (count == 0) {
+        return 0;
+    }
+    RingCopyIn(slot_(0), mask_, tail, elements.data(), count);
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+template <class T>
+size_t SpscRingBuffer<T>::TryPopN(std::span<T> elements) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < elements.size()) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+    }
+    size_t count = std::min(elements.size(), cached_tail_ - head);
+    if (count == 0) {
+        return 0;
+    }
+    RingMoveOut(slot_(0), mask_, head, elements.data(), count);
+    head_.store(head + count, std::memory_order_release);
+    return count;
+}
+
+template <class T>
+T* SpscRingBuffer<T>::slot_(size_t position) {
+    return reinterpret_cast<T*>(&buffer_[position & mask_]);
+}
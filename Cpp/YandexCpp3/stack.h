@@ -1,40 +1,181 @@
 #pragma once
-#include <iostream>
-#include <vector>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
 
+// Lock-free LIFO for any number of threads (Treiber's stack).
+//
+// Nodes are never returned to the allocator while the stack lives: popped
+// nodes go to an internal free list and are reused by later pushes. A
+// thread that loses a race may therefore still read a node's next field,
+// but that memory is always a valid node. Both list heads are 64-bit words
+// holding a 32-bit node index and a 32-bit tag that every successful CAS
+// bumps, so a head that was popped and pushed back in between (ABA) fails
+// the CAS instead of corrupting the list. Node indices address chunks of
+// doubling size, so the stack grows without moving nodes.
+template <class T = int>
 class Stack {
  public:
-    void Push(int x);
-    bool Pop();
+    Stack() = default;
+    ~Stack();
 
-    int Top() const;
+    Stack(const Stack&) = delete;
+    Stack& operator=(const Stack&) = delete;
+
+    void Push(const T& element);
+    void Push(T&& element);
+
+    template <class... Args>
+    void Emplace(Args&&... args);
+
+    bool Pop(T* element);
+
+    // Exact only when no thread is pushing or popping.
     bool Empty() const;
     size_t Size() const;
 
  private:
-    std::vector<int> container_;
+    // Chunk k holds indices [2^k, 2^(k + 1)); index 0 is the null node.
+    static const int kFirstChunk = 6;
+    static const int kChunks = 32;
+
+    struct Node {
+        std::atomic<uint32_t> next{0};
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+        T* element() {
+            return reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    std::atomic<uint64_t> head_{0};
+    std::atomic<uint64_t> free_{0};
+    std::atomic<uint64_t> fresh_{uint64_t(1) << kFirstChunk};
+    std::atomic<size_t> size_{0};
+    std::atomic<Node*> chunks_[kChunks] = {};
+
+    Node* node_(uint32_t index) const;
+    uint32_t allocate_();
+
+    void push_(std::atomic<uint64_t>* head, uint32_t index);
+    uint32_t pop_(std::atomic<uint64_t>* head);
 };
 
-void Stack::Push(int x) {
-    container_.push_back(x);
+template <class T>
+Stack<T>::~Stack() {
+    for (uint32_t index = head_.load() & 0xffffffff; index; index = node_(index)->next) {
+        node_(index)->element()->~T();
+    }
+    for (int k = 0; k < kChunks; ++k) {
+        delete[] chunks_[k].load();
+    }
+}
+
+template <class T>
+void Stack<T>::Push(const T& element) {
+    Emplace(element);
+}
+
+template <class T>
+void Stack<T>::Push(T&& element) {
+    Emplace(std::move(element));
+}
+
+template <class T>
+template <class... Args>
+void Stack<T>::Emplace(Args&&... args) {
+    uint32_t index = allocate_();
+    try {
+        new (node_(index)->element()) T(std::forward<Args>(args)...);
+    } catch (...) {
+        push_(&free_, index);
+        throw;
+    }
+    push_(&head_, index);
+    size_.fetch_add(1, std::memory_order_relaxed);
 }
 
-bool Stack::Pop() {
-    if (container_.size() > 0) {
-        container_.pop_back();
-        return true;
+template <class T>
+bool Stack<T>::Pop(T* element) {
+    uint32_t index = pop_(&head_);
+    if (!index) {
+        return false;
     }
-    return false;
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    T* slot = node_(index)->element();
+    *element = std::move(*slot);
+    slot->~T();
+    push_(&free_, index);
+    return true;
+}
+
+template <class T>
+bool Stack<T>::Empty() const {
+    return (head_.load(std::memory_order_acquire) & 0xffffffff) == 0;
+}
+
+template <class T>
+size_t Stack<T>::Size() const {
+    return size_.load(std::memory_order_relaxed);
 }
 
-int Stack::Top() const {
-    return container_.back();
+template <class T>
+typename Stack<T>::Node* Stack<T>::node_(uint32_t index) const {
+    int k = std::bit_width(index) - 1;
+    return chunks_[k].load(std::memory_order_acquire) + (index - (uint32_t(1) << k));
 }
 
-size_t Stack::Size() const {
-    return container_.size();
+template <class T>
+uint32_t Stack<T>::allocate_() {
+    if (uint32_t index = pop_(&free_)) {
+        return index;
+    }
+    uint64_t index = fresh_.fetch_add(1, std::memory_order_relaxed);
+    int k = std::bit_width(index) - 1;
+    if (k >= kChunks) {
+        throw std::bad_alloc();
+    }
+    if (!chunks_[k].load(std::memory_order_acquire)) {
+        // Several threads may get here for the same chunk; one wins.
+        Node* chunk = new Node[size_t(1) << k];
+        Node* expected = nullptr;
+        if (!chunks_[k].compare_exchange_strong(expected, chunk, std::memory_order_acq_rel)) {
+            delete[] chunk;
+        }
+    }
+    return index;
 }
 
-bool Stack::Empty() const {
-    return container_.empty();
+template <class T>
+void Stack<T>::push_(std::atomic<uint64_t>* head, uint32_t index) {
+    Node* node = node_(index);
+    uint64_t current = head->load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        node->next.store(current & 0xffffffff, std::memory_order_relaxed);
+        next = ((current >> 32) + 1) << 32 | index;
+    } while (!head->compare_exchange_weak(current, next, std::memory_order_release,
+                                          std::memory_order_relaxed));
+}
+
+template <class T>
+uint32_t Stack<T>::pop_(std::atomic<uint64_t>* head) {
+    uint64_t current = head->load(std::memory_order_acquire);
+    while (true) {
+        uint32_t index = current & 0xffffffff;
+        if (!index) {
+            return 0;
+        }
+        // May be stale if another thread took the node meanwhile; the tag
+        // then makes the CAS fail.
+        uint64_t next = ((current >> 32) + 1) << 32 | node_(index)->next.load(std::memory_order_relaxed);
+        if (head->compare_exchange_weak(current, next, std::memory_order_acquire,
+                                        std::memory_order_acquire)) {
+            return index;
+        }
+    }
 }
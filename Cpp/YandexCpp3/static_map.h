@@ -2,36 +2,809 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iterator>
+#include <memory>
+#include <numeric>
+#include <optional>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bloom_filter.h"
+#include "perfect_hash.h"
+
+// Read-only map from strings to strings, stored in one flat image whether
+// it was built in memory or mapped from a file written by Write:
+//
+//     ImageHeader
+//     index                                      depends on the layout
+//     uint64_t  blocks[2 * block_count + 2]      where each block of entries
+//                                                starts in keys[] and where
+//                                                its values start in values[]
+//     char      keys[]                           see below
+//     char      values[]
+//
+// so Open only maps the file and points into it. Items are sorted by key
+// and stored in blocks. An entry is a varint count of bytes the key shares
+// with the key before it, varint lengths of the rest of the key and of the
+// value, and the rest of the key; the values of a block follow each other.
+// The first entry of a block shares nothing, so a block decodes on its own
+// and its first key can be read in place. The key encoding sets the block
+// size:
+//
+//   kPlain        Blocks of one item, so every key is stored whole and
+//                 Find compares the query with a single key in place.
+//   kFrontCoded   Blocks of 8 items. Keys such as URLs, which mostly
+//                 repeat the key before them, take a few bytes each, but
+//                 Find walks the block up to its key.
+//
+// Range and prefix scans work with both. The index is one of
+//
+//   kPerfectHash  PerfectHash buckets plus a slot -> item table. Find
+//                 hashes the key once and goes to its item: O(1) worst
+//                 case.
+//   kEytzinger    8 bytes of every key as a big-endian integer, in BFS
+//                 order of the implicit search tree, plus the item each
+//                 node stands for. The bytes are taken after the prefix
+//                 that all keys share ("user:" and the like), since it
+//                 tells no keys apart. The search descends with integer
+//                 compares and prefetches three levels ahead (one cache
+//                 line holds a node's 8 great-grandchildren); full keys are
+//                 only compared when the prefixes tie.
+//
+// A map built in memory may also keep a BlockedBloomFilter of its keys in
+// front of the index, for workloads where most lookups miss: an absent key
+// is then usually rejected after one cache line instead of a full search.
+// The filter is not part of the image.
 class StaticMap {
  public:
+    enum class Layout {
+        kPerfectHash,
+        kEytzinger
+    };
+
+    enum class KeyEncoding {
+        kPlain,
+        kFrontCoded
+    };
+
+    // A false_positive_rate in (0, 1) builds a Bloom filter with about
+    // that rate; 0 builds none.
     explicit StaticMap(const std::vector<
                     std::pair<std::string,
-                    std::string>>& items);
+                    std::string>>& items,
+                    Layout layout = Layout::kPerfectHash,
+                    double false_positive_rate = 0,
+                    KeyEncoding encoding = KeyEncoding::kPlain);
+
+    StaticMap(StaticMap&& other);
+    StaticMap& operator=(StaticMap&& other);
+    ~StaticMap();
+
+    StaticMap(const StaticMap&) = delete;
+    StaticMap& operator=(const StaticMap&) = delete;
+
+    // Builds the image for `items` and writes it to `path` (through a
+    // temporary file, so readers never see a partial image).
+    static bool Write(const std::vector<std::pair<std::string, std::string>>& items,
+                      const std::string& path, Layout layout = Layout::kPerfectHash,
+                      KeyEncoding encoding = KeyEncoding::kPlain);
+
+    // Maps an image written by Write. The file must not change while the
+    // map is open. Returns nothing if it is not a valid image: every table
+    // and key entry is checked against the file in one sequential pass, so
+    // a damaged file is refused instead of read out of bounds.
+    static std::optional<StaticMap> Open(const std::string& path);
 
-    bool Find(const std::string& key, std::string* value) const;
+    bool Find(std::string_view key, std::string* value) const;
+
+    // Call callback(key, value) in key order for the keys in [from, to)
+    // and for the keys starting with `prefix`. Both find the first key in
+    // O(log n) and then decode the following ones in sequence.
+    template <class Callback>
+    void ForEachInRange(std::string_view from, std::string_view to, Callback callback) const;
+    template <class Callback>
+    void ForEachWithPrefix(std::string_view prefix, Callback callback) const;
+
+    size_t Size() const;
+    Layout GetLayout() const;
+    KeyEncoding GetKeyEncoding() const;
+
+    // False if the Bloom filter rules the key out, which is what Find
+    // checks first; true for a map without a filter. Lets callers measure
+    // how many lookups the filter answers without Find counting them.
+    bool MayContain(std::string_view key) const;
 
  private:
-    std::vector<std::pair<std::string, std::string>> items_;
+    static constexpr uint32_t kMagic = 0x50414d53;
+    static constexpr uint32_t kVersion = 4;
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+    static constexpr size_t kCacheLine = 64;
+    static constexpr uint32_t kFrontCodedBlockBits = 3;
+
+    struct ImageHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t layout;
+        // Length of the prefix all keys share, which kEytzinger skips.
+        uint32_t common_prefix;
+        // Blocks hold 1 << block_bits items: 0 for kPlain.
+        uint32_t block_bits;
+        uint32_t reserved;
+        uint64_t count;
+        uint64_t key_bytes;
+        uint64_t value_bytes;
+        PerfectHash::Header hash;
+    };
+
+    // Byte offsets of the sections, computed from the header alone.
+    struct Sections {
+        size_t buckets = 0;
+        size_t slots = 0;
+        size_t prefixes = 0;
+        size_t ranks = 0;
+        size_t blocks = 0;
+        size_t keys = 0;
+        size_t values = 0;
+        size_t end = 0;
+    };
+
+    struct alignas(kCacheLine) CacheLine {
+        char bytes[kCacheLine];
+    };
+
+    // Either owned_ holds the image or it is mapped_size_ bytes of mmap.
+    std::vector<CacheLine> owned_;
+    const char* image_ = nullptr;
+    size_t mapped_size_ = 0;
+
+    const ImageHeader* header_ = nullptr;
+    const PerfectHash::Bucket* buckets_ = nullptr;
+    const uint32_t* slots_ = nullptr;
+    // 1-based, so that node k has children 2k and 2k + 1.
+    const uint64_t* prefixes_ = nullptr;
+    const uint32_t* ranks_ = nullptr;
+    const uint64_t* blocks_ = nullptr;
+    const char* keys_ = nullptr;
+    const char* values_ = nullptr;
+
+    std::optional<BlockedBloomFilter> filter_;
+
+    // Points into an image; munmaps it on destruction if mapped_size is
+    // not zero.
+    StaticMap(const char* image, size_t mapped_size);
+
+    static std::vector<CacheLine> BuildImage(
+        const std::vector<std::pair<std::string, std::string>>& items, Layout layout,
+        KeyEncoding encoding);
+
+    // Fails if the header's counts would overflow.
+    static bool GetSections(const ImageHeader& header, Sections* sections);
+
+    // The first 8 bytes of key, zero-padded, so that integer order agrees
+    // with string order up to ties.
+    static uint64_t Prefix(std::string_view key);
+
+    static void AppendVarint(uint64_t value, std::string* out);
+    static const char* ReadVarint(const char* data, uint64_t* value);
+    // As above, but returns nullptr if the varint does not end before `end`.
+    static const char* ReadVarint(const char* data, const char* end, uint64_t* value);
+    // Applies the entry at `entry` to `key` and `value`, which hold the
+    // item before it, and returns the next entry.
+    static const char* DecodeKey(const char* entry, std::string* key, std::string_view* value);
+
+    void Attach(const char* image);
+    void Release();
+
+    // Checks that every offset, item number and entry the lookups follow
+    // stays inside the image.
+    bool Validate() const;
+
+    size_t BlockCount() const;
+    size_t BlockSize() const;
+    // The first key of a block, read in place.
+    std::string_view BlockHead(size_t block) const;
+
+    // Compares the keys of `index`'s block with `key` in order, stopping
+    // at the first key that is not less than `key` or at `index`. Returns
+    // where it stopped; `order` gets the sign of that key minus `key`, and
+    // `value` its value. Nothing is decoded: only the length of the match
+    // with `key` is kept.
+    size_t ScanBlock(size_t index, std::string_view key, int* order,
+                     std::string_view* value) const;
+    // The sign of key `index` minus `key`.
+    int CompareKey(size_t index, std::string_view key) const;
+    // Decodes item `index` into `key` and `value` and returns the entry
+    // after it.
+    const char* SeekKey(size_t index, std::string* key, std::string_view* value) const;
+
+    // Index of the first item whose key is not less than `key`.
+    size_t LowerBound(std::string_view key) const;
 };
 
 StaticMap::StaticMap(const std::vector<
                 std::pair<std::string,
-                std::string>> &items) {
-    items_ = items;
-    std::sort(items_.begin(), items_.end());
+                std::string>> &items, Layout layout, double false_positive_rate,
+                KeyEncoding encoding) {
+    owned_ = BuildImage(items, layout, encoding);
+    Attach(owned_.front().bytes);
+    if (false_positive_rate > 0) {
+        filter_.emplace(items.size(), false_positive_rate);
+        for (const auto& item : items) {
+            filter_->Add(item.first);
+        }
+    }
+}
+
+StaticMap::StaticMap(const char* image, size_t mapped_size) : mapped_size_(mapped_size) {
+    Attach(image);
+}
+
+StaticMap::StaticMap(StaticMap&& other) {
+    *this = std::move(other);
+}
+
+StaticMap& StaticMap::operator=(StaticMap&& other) {
+    if (this != &other) {
+        Release();
+        owned_ = std::move(other.owned_);
+        mapped_size_ = other.mapped_size_;
+        // A moved vector keeps its buffer, so the pointers stay valid.
+        Attach(other.image_);
+        other.owned_.clear();
+        other.image_ = nullptr;
+        other.mapped_size_ = 0;
+        filter_ = std::move(other.filter_);
+        other.filter_.reset();
+    }
+    return *this;
+}
+
+StaticMap::~StaticMap() {
+    Release();
+}
+
+bool StaticMap::Write(const std::vector<std::pair<std::string, std::string>>& items,
+                      const std::string& path, Layout layout, KeyEncoding encoding) {
+    std::vector<CacheLine> image = BuildImage(items, layout, encoding);
+    Sections sections;
+    GetSections(*reinterpret_cast<const ImageHeader*>(image.data()), &sections);
+    std::string tmp_path = path + ".tmp";
+    std::unique_ptr<FILE, int (*)(FILE*)> file(fopen(tmp_path.c_str(), "wb"), fclose);
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(image.data(), 1, sections.end, file.get()) == sections.end;
+    ok = fflush(file.get()) == 0 && ok;
+    file.reset();
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::optional<StaticMap> StaticMap::Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return std::nullopt;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ImageHeader)) {
+        close(fd);
+        return std::nullopt;
+    }
+    size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return std::nullopt;
+    }
+    const ImageHeader* header = static_cast<const ImageHeader*>(data);
+    Sections sections;
+    if (header->magic != kMagic || header->version != kVersion ||
+        header->layout > static_cast<uint32_t>(Layout::kEytzinger) ||
+        (header->block_bits != 0 && header->block_bits != kFrontCodedBlockBits) ||
+        !GetSections(*header, &sections) || sections.end != size) {
+        munmap(data, size);
+        return std::nullopt;
+    }
+    StaticMap map(static_cast<const char*>(data), size);
+    if (!map.Validate()) {
+        return std::nullopt;
+    }
+    return map;
+}
+
+bool StaticMap::Find(std::string_view key, std::string *value) const {
+    if (!MayContain(key)) {
+        return false;
+    }
+    size_t index;
+    if (GetLayout() == Layout::kPerfectHash) {
+        size_t slot = PerfectHash::Slot(header_->hash, buckets_, key);
+        if (slot == PerfectHash::kNoSlot || slots_[slot] == kEmpty) {
+            return false;
+        }
+        index = slots_[slot];
+    } else {
+        index = LowerBound(key);
+        if (index == header_->count) {
+            return false;
+        }
+    }
+    int order;
+    std::string_view found;
+    if (ScanBlock(index, key, &order, &found) != index || order != 0) {
+        return false;
+    }
+    value->assign(found.data(), found.size());
+    return true;
+}
+
+template <class Callback>
+void StaticMap::ForEachInRange(std::string_view from, std::string_view to,
+                               Callback callback) const {
+    size_t index = LowerBound(from);
+    if (index == header_->count) {
+        return;
+    }
+    std::string key;
+    std::string_view value;
+    const char* entry = SeekKey(index, &key, &value);
+    while (std::string_view(key) < to) {
+        callback(std::string_view(key), value);
+        if (++index == header_->count) {
+            break;
+        }
+        entry = DecodeKey(entry, &key, &value);
+    }
+}
+
+template <class Callback>
+void StaticMap::ForEachWithPrefix(std::string_view prefix, Callback callback) const {
+    size_t index = LowerBound(prefix);
+    if (index == header_->count) {
+        return;
+    }
+    std::string key;
+    std::string_view value;
+    const char* entry = SeekKey(index, &key, &value);
+    while (std::string_view(key).starts_with(prefix)) {
+        callback(std::string_view(key), value);
+        if (++index == header_->count) {
+            break;
+        }
+        entry = DecodeKey(entry, &key, &value);
+    }
+}
+
+size_t StaticMap::Size() const {
+    return header_->count;
+}
+
+StaticMap::Layout StaticMap::GetLayout() const {
+    return static_cast<Layout>(header_->layout);
+}
+
+StaticMap::KeyEncoding StaticMap::GetKeyEncoding() const {
+    return header_->block_bits ? KeyEncoding::kFrontCoded : KeyEncoding::kPlain;
+}
+
+bool StaticMap::MayContain(std::string_view key) const {
+    return !filter_ || filter_->MayContain(key);
+}
+
+// With duplicate keys the smallest value wins, as it did when Find was a
+// binary search over the sorted items.
+std::vector<StaticMap::CacheLine> StaticMap::BuildImage(
+        const std::vector<std::pair<std::string, std::string>>& items, Layout layout,
+        KeyEncoding encoding) {
+    std::vector<size_t> order(items.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&items](size_t lhs, size_t rhs) {
+        return items[lhs] < items[rhs];
+    });
+    order.erase(std::unique(order.begin(), order.end(), [&items](size_t lhs, size_t rhs) {
+                    return items[lhs].first == items[rhs].first;
+                }),
+                order.end());
+
+    std::vector<std::string_view> keys;
+    keys.reserve(order.size());
+    ImageHeader header = {};
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.layout = static_cast<uint32_t>(layout);
+    header.block_bits = encoding == KeyEncoding::kFrontCoded ? kFrontCodedBlockBits : 0;
+    header.count = order.size();
+    size_t block_mask = (size_t(1) << header.block_bits) - 1;
+    std::string encoded;
+    std::vector<uint64_t> blocks;
+    for (size_t index : order) {
+        std::string_view key = items[index].first;
+        size_t shared = 0;
+        if ((keys.size() & block_mask) == 0) {
+            blocks.push_back(encoded.size());
+            blocks.push_back(header.value_bytes);
+        } else {
+            std::string_view previous = keys.back();
+            while (shared < key.size() && shared < previous.size() &&
+                   key[shared] == previous[shared]) {
+                ++shared;
+            }
+        }
+        AppendVarint(shared, &encoded);
+        AppendVarint(key.size() - shared, &encoded);
+        AppendVarint(items[index].second.size(), &encoded);
+        encoded.append(key.substr(shared));
+        keys.push_back(key);
+        header.value_bytes += items[index].second.size();
+    }
+    blocks.push_back(encoded.size());
+    blocks.push_back(header.value_bytes);
+    header.key_bytes = encoded.size();
+    if (layout == Layout::kEytzinger && !keys.empty()) {
+        // Sorted, so the first and the last key share the least.
+        auto mismatch = std::mismatch(keys.front().begin(), keys.front().end(),
+                                      keys.back().begin(), keys.back().end());
+        header.common_prefix = std::min<size_t>(mismatch.first - keys.front().begin(),
+                                                UINT32_MAX);
+    }
+    PerfectHash hash;
+    if (layout == Layout::kPerfectHash) {
+        hash.Initialize(keys);
+        header.hash = hash.GetHeader();
+    }
+
+    Sections sections;
+    GetSections(header, &sections);
+    std::vector<CacheLine> image((sections.end + kCacheLine - 1) / kCacheLine);
+    std::memcpy(image.data(), &header, sizeof(header));
+    StaticMap map(image.front().bytes, 0);
+
+    if (layout == Layout::kPerfectHash) {
+        std::copy(hash.GetBuckets().begin(), hash.GetBuckets().end(),
+                  const_cast<PerfectHash::Bucket*>(map.buckets_));
+        uint32_t* slots = const_cast<uint32_t*>(map.slots_);
+        std::fill(slots, slots + header.hash.slot_count, kEmpty);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            slots[hash.Slot(keys[i])] = i;
+        }
+    } else {
+        // An in-order walk of the implicit tree visits the keys sorted.
+        uint64_t* prefixes = const_cast<uint64_t*>(map.prefixes_);
+        uint32_t* ranks = const_cast<uint32_t*>(map.ranks_);
+        size_t rank = 0;
+        size_t node = 1;
+        std::vector<size_t> path;
+        while (node <= keys.size() || !path.empty()) {
+            if (node <= keys.size()) {
+                path.push_back(node);
+                node *= 2;
+            } else {
+                node = path.back();
+                path.pop_back();
+                prefixes[node] = Prefix(keys[rank].substr(header.common_prefix));
+                ranks[node] = rank++;
+                node = 2 * node + 1;
+            }
+        }
+    }
+
+    std::copy(blocks.begin(), blocks.end(), const_cast<uint64_t*>(map.blocks_));
+    std::copy(encoded.begin(), encoded.end(), const_cast<char*>(map.keys_));
+    char* values = const_cast<char*>(map.values_);
+    for (size_t index : order) {
+        values = std::copy(items[index].second.begin(), items[index].second.end(), values);
+    }
+    return image;
+}
+
+bool StaticMap::GetSections(const ImageHeader& header, Sections* sections) {
+    // Rejects counts that would wrap around when a damaged header is read.
+    const uint64_t kLimit = uint64_t(1) << 40;
+    if (header.count >= kLimit || header.key_bytes >= kLimit || header.value_bytes >= kLimit ||
+        header.hash.bucket_count >= kLimit || header.hash.slot_count >= kLimit ||
+        header.block_bits > kFrontCodedBlockBits) {
+        return false;
+    }
+    auto align = [](size_t offset, size_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    };
+    size_t offset = align(sizeof(ImageHeader), kCacheLine);
+    if (header.layout == static_cast<uint32_t>(Layout::kPerfectHash)) {
+        sections->buckets = offset;
+        offset += header.hash.bucket_count * sizeof(PerfectHash::Bucket);
+        sections->slots = offset;
+        offset = align(offset + header.hash.slot_count * sizeof(uint32_t), 8);
+    } else {
+        sections->prefixes = offset;
+        offset += (header.count + 1) * sizeof(uint64_t);
+        sections->ranks = offset;
+        offset = align(offset + (header.count + 1) * sizeof(uint32_t), 8);
+    }
+    sections->blocks = offset;
+    size_t block_count = (header.count + (uint64_t(1) << header.block_bits) - 1) >>
+                         header.block_bits;
+    offset += (block_count + 1) * 2 * sizeof(uint64_t);
+    sections->keys = offset;
+    offset += header.key_bytes;
+    sections->values = offset;
+    sections->end = offset + header.value_bytes;
+    return true;
+}
+
+uint64_t StaticMap::Prefix(std::string_view key) {
+    unsigned char bytes[8] = {};
+    std::copy_n(key.data(), std::min<size_t>(key.size(), 8), bytes);
+    uint64_t prefix = 0;
+    for (unsigned char byte : bytes) {
+        prefix = prefix << 8 | byte;
+    }
+    return prefix;
+}
+
+void StaticMap::AppendVarint(uint64_t value, std::string* out) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+const char* StaticMap::ReadVarint(const char* data, uint64_t* value) {
+    if (static_cast<unsigned char>(*data) < 0x80) {
+        *value = static_cast<unsigned char>(*data);
+        return data + 1;
+    }
+    *value = 0;
+    for (int shift = 0;; shift += 7) {
+        unsigned char byte = *data++;
+        *value |= uint64_t(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return data;
+        }
+    }
+}
+
+const char* StaticMap::ReadVarint(const char* data, const char* end, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        unsigned char byte = *data++;
+        *value |= uint64_t(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return data;
+        }
+    }
+    return nullptr;
+}
+
+const char* StaticMap::DecodeKey(const char* entry, std::string* key,
+                                 std::string_view* value) {
+    uint64_t shared, length, value_length;
+    entry = ReadVarint(entry, &shared);
+    entry = ReadVarint(entry, &length);
+    entry = ReadVarint(entry, &value_length);
+    key->resize(shared);
+    key->append(entry, length);
+    *value = std::string_view(value->data() + value->size(), value_length);
+    return entry + length;
+}
+
+void StaticMap::Attach(const char* image) {
+    image_ = image;
+    if (!image_) {
+        return;
+    }
+    header_ = reinterpret_cast<const ImageHeader*>(image_);
+    Sections sections;
+    GetSections(*header_, &sections);
+    buckets_ = reinterpret_cast<const PerfectHash::Bucket*>(image_ + sections.buckets);
+    slots_ = reinterpret_cast<const uint32_t*>(image_ + sections.slots);
+    prefixes_ = reinterpret_cast<const uint64_t*>(image_ + sections.prefixes);
+    ranks_ = reinterpret_cast<const uint32_t*>(image_ + sections.ranks);
+    blocks_ = reinterpret_cast<const uint64_t*>(image_ + sections.blocks);
+    keys_ = image_ + sections.keys;
+    values_ = image_ + sections.values;
+}
+
+bool StaticMap::Validate() const {
+    uint64_t count = header_->count;
+    if (GetLayout() == Layout::kPerfectHash) {
+        const PerfectHash::Header& hash = header_->hash;
+        if (hash.bucket_count != 0 && hash.hash_function.GetSize() != hash.bucket_count) {
+            return false;
+        }
+        for (uint64_t i = 0; i < hash.bucket_count; ++i) {
+            uint64_t size = buckets_[i].hash_function.GetSize();
+            if (size != 0 && (buckets_[i].offset > hash.slot_count ||
+                              size > hash.slot_count - buckets_[i].offset)) {
+                return false;
+            }
+        }
+        for (uint64_t i = 0; i < hash.slot_count; ++i) {
+            if (slots_[i] != kEmpty && slots_[i] >= count) {
+                return false;
+            }
+        }
+    } else {
+        for (uint64_t node = 1; node <= count; ++node) {
+            if (ranks_[node] >= count) {
+                return false;
+            }
+        }
+    }
+
+    size_t block_count = BlockCount();
+    if (blocks_[0] != 0 || blocks_[1] != 0 || blocks_[2 * block_count] != header_->key_bytes ||
+        blocks_[2 * block_count + 1] != header_->value_bytes) {
+        return false;
+    }
+    for (size_t block = 0; block < block_count; ++block) {
+        if (blocks_[2 * block + 2] < blocks_[2 * block] ||
+            blocks_[2 * block + 3] < blocks_[2 * block + 1]) {
+            return false;
+        }
+        const char* entry = keys_ + blocks_[2 * block];
+        const char* end = keys_ + blocks_[2 * block + 2];
+        uint64_t value_bytes = 0;
+        uint64_t previous_length = 0;
+        size_t items = std::min<uint64_t>(BlockSize(), count - (block << header_->block_bits));
+        for (size_t i = 0; i < items; ++i) {
+            uint64_t shared, length, value_length;
+            if (!(entry = ReadVarint(entry, end, &shared)) ||
+                !(entry = ReadVarint(entry, end, &length)) ||
+                !(entry = ReadVarint(entry, end, &value_length)) ||
+                shared > previous_length || length > static_cast<uint64_t>(end - entry) ||
+                value_length > header_->value_bytes - value_bytes) {
+                return false;
+            }
+            entry += length;
+            previous_length = shared + length;
+            value_bytes += value_length;
+        }
+        if (entry != end || value_bytes != blocks_[2 * block + 3] - blocks_[2 * block + 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StaticMap::Release() {
+    if (mapped_size_) {
+        munmap(const_cast<char*>(image_), mapped_size_);
+        mapped_size_ = 0;
+    }
+    image_ = nullptr;
+    owned_.clear();
+}
+
+size_t StaticMap::BlockCount() const {
+    return (header_->count + BlockSize() - 1) >> header_->block_bits;
+}
+
+size_t StaticMap::BlockSize() const {
+    return size_t(1) << header_->block_bits;
+}
+
+std::string_view StaticMap::BlockHead(size_t block) const {
+    uint64_t shared, length, value_length;
+    const char* entry = ReadVarint(keys_ + blocks_[2 * block], &shared);
+    entry = ReadVarint(entry, &length);
+    entry = ReadVarint(entry, &value_length);
+    return std::string_view(entry, length);
+}
+
+size_t StaticMap::ScanBlock(size_t index, std::string_view key, int* order,
+                            std::string_view* value) const {
+    size_t block = index >> header_->block_bits;
+    size_t current = block << header_->block_bits;
+    const char* entry = keys_ + blocks_[2 * block];
+    const char* value_begin = values_ + blocks_[2 * block + 1];
+    // The previous key agreed with `key` on its first `matched` bytes.
+    size_t matched = 0;
+    int sign = 0;
+    while (true) {
+        uint64_t shared, length, value_length;
+        entry = ReadVarint(entry, &shared);
+        entry = ReadVarint(entry, &length);
+        entry = ReadVarint(entry, &value_length);
+        // Sharing more than `matched` bytes keeps the previous mismatch.
+        if (shared <= matched) {
+            const unsigned char* suffix = reinterpret_cast<const unsigned char*>(entry);
+            const unsigned char* rest = reinterpret_cast<const unsigned char*>(key.data()) + shared;
+            size_t rest_size = key.size() - shared;
+            size_t common = 0;
+            while (common < length && common < rest_size && suffix[common] == rest[common]) {
+                ++common;
+            }
+            matched = shared + common;
+            if (common < length && common < rest_size) {
+                sign = suffix[common] < rest[common] ? -1 : 1;
+            } else {
+                sign = (common < length) - (common < rest_size);
+            }
+        }
+        if (sign >= 0 || current == index) {
+            *order = sign;
+            *value = std::string_view(value_begin, value_length);
+            return current;
+        }
+        entry += length;
+        value_begin += value_length;
+        ++current;
+    }
 }
 
-bool StaticMap::Find(const std::string &key, std::string *value) const {
-    auto it = std::lower_bound(items_.begin(),
-                               items_.end(),
-                               std::make_pair(key, std::string("")));
-    if (it != items_.end() && (*it).first == key) {
-        (*value) = (*it).second;
-        return true;
+int StaticMap::CompareKey(size_t index, std::string_view key) const {
+    int order;
+    std::string_view value;
+    // An earlier key of the block is already not less than `key`.
+    return ScanBlock(index, key, &order, &value) < index ? 1 : order;
+}
+
+const char* StaticMap::SeekKey(size_t index, std::string* key, std::string_view* value) const {
+    size_t block = index >> header_->block_bits;
+    const char* entry = keys_ + blocks_[2 * block];
+    key->clear();
+    *value = std::string_view(values_ + blocks_[2 * block + 1], 0);
+    for (size_t current = block << header_->block_bits; current <= index; ++current) {
+        entry = DecodeKey(entry, key, value);
+    }
+    return entry;
+}
+
+size_t StaticMap::LowerBound(std::string_view key) const {
+    size_t count = header_->count;
+    if (count == 0) {
+        return 0;
+    }
+    if (GetLayout() == Layout::kPerfectHash) {
+        // Binary search over the first keys of the blocks, then a scan of
+        // the block before the first one that is not less than `key`.
+        size_t low = 0, high = BlockCount();
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (BlockHead(middle) < key) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if (low == 0) {
+            return 0;
+        }
+        size_t last = std::min(low * BlockSize(), count) - 1;
+        int order;
+        std::string_view value;
+        size_t index = ScanBlock(last, key, &order, &value);
+        return order < 0 ? index + 1 : index;
+    }
+    std::string_view common = BlockHead(0).substr(0, header_->common_prefix);
+    int order = key.substr(0, common.size()).compare(common);
+    if (order != 0 || key.size() < common.size()) {
+        // Every key starts with `common`, so they are all on one side.
+        return order > 0 ? count : 0;
+    }
+    uint64_t prefix = Prefix(key.substr(common.size()));
+    size_t node = 1;
+    while (node <= count) {
+        __builtin_prefetch(prefixes_ + node * 8);
+        uint64_t node_prefix = prefixes_[node];
+        bool less = node_prefix < prefix ||
+                    (node_prefix == prefix && CompareKey(ranks_[node], key) < 0);
+        node = 2 * node + less;
     }
-    return false;
+    // Undo the right turns taken after the last left one.
+    node >>= __builtin_ffsll(~node);
+    return node == 0 ? count : ranks_[node];
 }
@@ -0,0 +1,37 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "static_map.h"
+
+// Offline builder of StaticMap images: reads "key<TAB>value" lines and
+// writes an image that StaticMap::Open maps directly.
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <input.tsv> <output>" << std::endl;
+        return 2;
+    }
+    std::ifstream input(argv[1]);
+    if (!input) {
+        std::cerr << "cannot read " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<std::pair<std::string, std::string>> items;
+    std::string line;
+    while (std::getline(input, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) {
+            items.emplace_back(line, "");
+        } else {
+            items.emplace_back(line.substr(0, tab), line.substr(tab + 1));
+        }
+    }
+    if (!StaticMap::Write(items, argv[2])) {
+        std::cerr << "cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << items.size() << " items written to " << argv[2] << std::endl;
+    return 0;
+}
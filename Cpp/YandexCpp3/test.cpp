@@ -1,6 +1,8 @@
 #include <iostream>
 #include <vector>
 #include <cassert>
+#include <memory>
+#include <thread>
 
 #include "stack.h"
 
@@ -15,9 +17,10 @@
 
 void TestEmptyStack() {
     Stack s;
+    int x;
     ASSERT_EQ(true, s.Empty());
     ASSERT_EQ(0, s.Size());
-    ASSERT_EQ(false, s.Pop());
+    ASSERT_EQ(false, s.Pop(&x));
 }
 
 void TestSimplePushPop() {
@@ -27,11 +30,13 @@ void TestSimplePushPop() {
 
     ASSERT_EQ(2, s.Size());
     ASSERT_EQ(false, s.Empty());
-    ASSERT_EQ(43, s.Top());
 
-    ASSERT_EQ(true, s.Pop());
+    int x;
+    ASSERT_EQ(true, s.Pop(&x));
+    ASSERT_EQ(43, x);
     ASSERT_EQ(1, s.Size());
-    ASSERT_EQ(42, s.Top());
+    ASSERT_EQ(true, s.Pop(&x));
+    ASSERT_EQ(42, x);
 }
 
 void TestStress() {
@@ -41,18 +46,75 @@ void TestStress() {
         s.Push(i);
     }
 
+    int x;
     for (int i = 1023; i >= 0; --i) {
-        ASSERT_EQ(i, s.Top());
-        ASSERT_EQ(true, s.Pop());
+        ASSERT_EQ(true, s.Pop(&x));
+        ASSERT_EQ(i, x);
     }
 
     ASSERT_EQ(true, s.Empty());
 }
 
+void TestMoveOnly() {
+    Stack<std::unique_ptr<int>> s;
+    s.Emplace(new int(1));
+    s.Push(std::unique_ptr<int>(new int(2)));
+
+    std::unique_ptr<int> p;
+    ASSERT_EQ(true, s.Pop(&p));
+    ASSERT_EQ(2, *p);
+    // the one left behind is freed by the destructor
+}
+
+// Threads keep taking items off a shared free list and putting them back;
+// at the end every item must be there exactly once.
+void TestConcurrent() {
+    const int kThreads = 8;
+    const int kItems = 1000;
+    const int kRounds = 20000;
+    Stack s;
+    for (int i = 0; i < kItems; ++i) {
+        s.Push(i);
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&s] {
+            std::vector<int> taken;
+            for (int round = 0; round < kRounds; ++round) {
+                int x;
+                if (round % 3 != 2 && s.Pop(&x)) {
+                    taken.push_back(x);
+                } else if (!taken.empty()) {
+                    s.Push(taken.back());
+                    taken.pop_back();
+                }
+            }
+            for (int x : taken) {
+                s.Push(x);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(kItems, s.Size());
+    std::vector<bool> seen(kItems);
+    int x;
+    while (s.Pop(&x)) {
+        ASSERT_EQ(false, seen[x]);
+        seen[x] = true;
+    }
+    ASSERT_EQ(true, s.Empty());
+}
+
 int main() {
     TestEmptyStack();
     TestSimplePushPop();
     TestStress();
+    TestMoveOnly();
+    TestConcurrent();
 
     return 0;
 }
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "blocking_ring_buffer.h"
+#include "spsc_ring_buffer.h"
+
+#define ASSERT_EQ(expected, actual) { \
+    if (expected != actual) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": Assertion error" << std::endl; \
+        std::cerr << "\texpected: " << expected << " (= " << #expected << ")" << std::endl; \
+        std::cerr << "\tgot: " << actual << " (= " << #actual << ")" << std::endl; \
+        std::terminate(); \
+    } \
+}
+
+using std::chrono::milliseconds;
+
+void TestTimeout() {
+    BlockingRingBuffer<int> buffer(2);
+    int i;
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(false, buffer.Pop(&i, milliseconds(20)));
+    bool waited = std::chrono::steady_clock::now() - start >= milliseconds(20);
+    ASSERT_EQ(true, waited);
+
+    buffer.Push(1);
+    ASSERT_EQ(true, buffer.Push(2, milliseconds(20)));
+    start = std::chrono::steady_clock::now();
+    ASSERT_EQ(false, buffer.Push(3, milliseconds(20)));
+    waited = std::chrono::steady_clock::now() - start >= milliseconds(20);
+    ASSERT_EQ(true, waited);
+
+    ASSERT_EQ(true, buffer.Pop(&i, milliseconds(20)));
+    ASSERT_EQ(1, i);
+    buffer.Pop(&i);
+    ASSERT_EQ(2, i);
+}
+
+void TestWakeUp() {
+    BlockingRingBuffer<std::unique_ptr<int>, SpscRingBuffer> buffer(1);
+
+    std::thread consumer([&buffer] {
+        std::unique_ptr<int> element;
+        for (int i = 0; i < 3; ++i) {
+            // Long enough that the producer's sleep puts us on the futex.
+            ASSERT_EQ(true, buffer.Pop(&element, std::chrono::seconds(10)));
+            ASSERT_EQ(i, *element);
+        }
+    });
+    for (int i = 0; i < 3; ++i) {
+        std::this_thread::sleep_for(milliseconds(10));
+        buffer.Push(std::unique_ptr<int>(new int(i)));
+    }
+    consumer.join();
+    ASSERT_EQ(true, buffer.Empty());
+}
+
+// Tiny buffer, so both sides keep blocking on each other.
+void TestProducersConsumers(size_t capacity) {
+    const int kThreads = 4;
+    const int kElements = 50000;
+    BlockingRingBuffer<int64_t> buffer(capacity);
+
+    std::vector<std::thread> threads;
+    std::atomic<int64_t> sum(0);
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&buffer] {
+            for (int i = 0; i < kElements; ++i) {
+                buffer.Push(i);
+            }
+        });
+        threads.emplace_back([&buffer, &sum] {
+            int64_t element;
+            for (int i = 0; i < kElements; ++i) {
+                buffer.Pop(&element);
+                sum += element;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(int64_t(kThreads) * kElements * (kElements - 1) / 2, sum.load());
+    ASSERT_EQ(true, buffer.Empty());
+}
+
+int main() {
+    TestTimeout();
+    TestWakeUp();
+    TestProducersConsumers(4);
+    TestProducersConsumers(1);
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mpmc_ring_buffer.h"
+
+#define ASSERT_EQ(expected, actual) { \
+    if (expected != actual) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": Assertion error" << std::endl; \
+        std::cerr << "\texpected: " << expected << " (= " << #expected << ")" << std::endl; \
+        std::cerr << "\tgot: " << actual << " (= " << #actual << ")" << std::endl; \
+        std::terminate(); \
+    } \
+}
+
+void TestPushAndPop() {
+    // A single cell cannot tell a full slot from an empty one, so
+    // capacity 1 needs two.
+    for (int capacity : {1, 2, 3, 4}) {
+        MpmcRingBuffer<int> buffer(capacity);
+        ASSERT_EQ(size_t(capacity), buffer.Capacity());
+
+        int i;
+        ASSERT_EQ(false, buffer.TryPop(&i));
+        for (int round = 0; round < 5; ++round) {
+            for (int j = 0; j < capacity; ++j) {
+                ASSERT_EQ(true, buffer.TryPush(round * capacity + j));
+            }
+            ASSERT_EQ(false, buffer.TryPush(-1));
+            ASSERT_EQ(size_t(capacity), buffer.Size());
+            for (int j = 0; j < capacity; ++j) {
+                ASSERT_EQ(true, buffer.TryPop(&i));
+                ASSERT_EQ(round * capacity + j, i);
+            }
+            ASSERT_EQ(false, buffer.TryPop(&i));
+            ASSERT_EQ(true, buffer.Empty());
+        }
+    }
+
+    MpmcRingBuffer<int> batched(5);
+    int batch[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    ASSERT_EQ(5u, batched.TryPushN(std::span<const int>(batch, 8)));
+    ASSERT_EQ(0u, batched.TryPushN(std::span<const int>(batch, 8)));
+    ASSERT_EQ(2u, batched.TryPopN(std::span<int>(batch, 2)));
+    ASSERT_EQ(2u, batched.TryPushN(std::span<const int>(batch, 8)));
+    ASSERT_EQ(5u, batched.Size());
+
+    MpmcRingBuffer<std::unique_ptr<int>> pointers(2);
+    ASSERT_EQ(true, pointers.TryEmplace(new int(7)));
+    ASSERT_EQ(true, pointers.TryEmplace(new int(8)));
+    std::unique_ptr<int> p;
+    ASSERT_EQ(true, pointers.TryPop(&p));
+    ASSERT_EQ(7, *p);
+}
+
+// Every producer pushes its own increasing sequence; every consumer must
+// see each producer's elements in order, and all of them exactly once.
+void TestProducersConsumers(size_t capacity) {
+    const int kThreads = 4;
+    const int kElements = 200000;
+    MpmcRingBuffer<int64_t> buffer(capacity);
+
+    std::vector<std::thread> threads;
+    std::atomic<int64_t> popped_sum(0);
+    std::atomic<int> popped(0);
+    std::atomic<bool> ordered(true);
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&buffer, t] {
+            for (int64_t i = 0; i < kElements;) {
+                if (buffer.TryPush(int64_t(t) << 32 | i)) {
+                    ++i;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        threads.emplace_back([&] {
+            std::vector<int64_t> last(kThreads, -1);
+            int64_t element;
+            while (popped.load() < kThreads * kElements) {
+                if (buffer.TryPop(&element)) {
+                    int64_t producer = element >> 32;
+                    int64_t value = element & 0xffffffff;
+                    if (value <= last[producer]) {
+                        ordered = false;
+                    }
+                    last[producer] = value;
+                    popped_sum += value;
+                    ++popped;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(true, ordered.load());
+    ASSERT_EQ(int64_t(kThreads) * kElements * (kElements - 1) / 2, popped_sum.load());
+    ASSERT_EQ(true, buffer.Empty());
+}
+
+void TestBatchProducersConsumers() {
+    const int kThreads = 3;
+    const int kElements = 100000;
+    MpmcRingBuffer<int64_t> buffer(64);
+
+    std::vector<std::thread> threads;
+    std::atomic<int64_t> popped_sum(0);
+    std::atomic<int> popped(0);
+    std::atomic<bool> ordered(true);
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&buffer, t] {
+            std::vector<int64_t> batch(16);
+            for (int64_t i = 0; i < kElements;) {
+                size_t size = std::min<int64_t>(batch.size(), kElements - i);
+                for (size_t j = 0; j < size; ++j) {
+                    batch[j] = int64_t(t) << 32 | (i + j);
+                }
+                size_t pushed = buffer.TryPushN(std::span<const int64_t>(batch.data(), size));
+                if (pushed == 0) {
+                    std::this_thread::yield();
+                }
+                i += pushed;
+            }
+        });
+        threads.emplace_back([&] {
+            std::vector<int64_t> last(kThreads, -1);
+            std::vector<int64_t> batch(8);
+            while (popped.load() < kThreads * kElements) {
+                size_t count = buffer.TryPopN(batch);
+                for (size_t j = 0; j < count; ++j) {
+                    int64_t producer = batch[j] >> 32;
+                    int64_t value = batch[j] & 0xffffffff;
+                    if (value <= last[producer]) {
+                        ordered = false;
+                    }
+                    last[producer] = value;
+                    popped_sum += value;
+                }
+                popped += count;
+                if (count == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(true, ordered.load());
+    ASSERT_EQ(int64_t(kThreads) * kElements * (kElements - 1) / 2, popped_sum.load());
+    ASSERT_EQ(true, buffer.Empty());
+}
+
+int main() {
+    TestPushAndPop();
+    TestProducersConsumers(64);
+    TestProducersConsumers(37);
+    TestBatchProducersConsumers();
+    return 0;
+}
@@ -1,4 +1,8 @@
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "ring_buffer.h"
 
@@ -61,9 +65,134 @@ void TestRandom() {
     }
 }
 
+void TestWrapAround() {
+    RingBuffer<int> buffer(3);
+
+    int i;
+    for (int round = 0; round < 10; ++round) {
+        ASSERT_EQ(true, buffer.TryPush(round));
+        ASSERT_EQ(true, buffer.TryPush(round + 1));
+        ASSERT_EQ(true, buffer.TryPush(round + 2));
+        ASSERT_EQ(false, buffer.TryPush(round + 3));
+        ASSERT_EQ(true, buffer.TryPop(&i));
+        ASSERT_EQ(round, i);
+        ASSERT_EQ(true, buffer.TryPop(&i));
+        ASSERT_EQ(round + 1, i);
+        ASSERT_EQ(true, buffer.TryPop(&i));
+        ASSERT_EQ(round + 2, i);
+    }
+}
+
+void TestEmplace() {
+    RingBuffer<std::string> strings(2);
+    ASSERT_EQ(true, strings.TryEmplace(3, 'a'));
+    ASSERT_EQ(true, strings.TryPush("b"));
+    ASSERT_EQ(false, strings.TryEmplace("c"));
+
+    std::string s;
+    ASSERT_EQ(true, strings.TryPop(&s));
+    ASSERT_EQ("aaa", s);
+
+    RingBuffer<std::unique_ptr<int>> pointers(2);
+    ASSERT_EQ(true, pointers.TryEmplace(new int(42)));
+    ASSERT_EQ(true, pointers.TryPush(std::unique_ptr<int>(new int(43))));
+
+    std::unique_ptr<int> p;
+    ASSERT_EQ(true, pointers.TryPop(&p));
+    ASSERT_EQ(42, *p);
+    // the one left behind is freed by the destructor
+}
+
+void TestBatch() {
+    RingBuffer<int> buffer(6);
+    std::vector<int> in = {0, 1, 2, 3, 4, 5, 6, 7};
+    std::vector<int> out(8);
+
+    ASSERT_EQ(4, buffer.TryPushN(std::span<const int>(in.data(), 4)));
+    ASSERT_EQ(3, buffer.TryPopN(std::span<int>(out.data(), 3)));
+    ASSERT_EQ(2, out[2]);
+
+    // Positions 4..9 wrap past the end of the 8-slot array.
+    ASSERT_EQ(5, buffer.TryPushN(in));
+    ASSERT_EQ(6, buffer.Size());
+    ASSERT_EQ(0, buffer.TryPushN(in));
+    ASSERT_EQ(6, buffer.TryPopN(out));
+    ASSERT_EQ(3, out[0]);
+    ASSERT_EQ(0, out[1]);
+    ASSERT_EQ(4, out[5]);
+    ASSERT_EQ(0, buffer.TryPopN(out));
+
+    std::vector<std::string> strings = {"a", "b", "c"};
+    RingBuffer<std::string> string_buffer(2);
+    ASSERT_EQ(2, string_buffer.TryPushN(strings));
+    std::string s;
+    ASSERT_EQ(true, string_buffer.TryPop(&s));
+    ASSERT_EQ(1, string_buffer.TryPushN(std::span<const std::string>(strings.data() + 2, 1)));
+    ASSERT_EQ(2, string_buffer.TryPopN(strings));
+    ASSERT_EQ("b", strings[0]);
+    ASSERT_EQ("c", strings[1]);
+}
+
+// Counts live instances and throws from the copy constructor on demand.
+struct Fragile {
+    static int live;
+    static int copies_left;
+
+    explicit Fragile(int value = 0) : value(value) {
+        ++live;
+    }
+    Fragile(const Fragile& other) : value(other.value) {
+        if (copies_left-- == 0) {
+            throw std::runtime_error("copy");
+        }
+        ++live;
+    }
+    Fragile& operator=(const Fragile&) = default;
+    ~Fragile() {
+        --live;
+    }
+
+    int value;
+};
+
+int Fragile::live = 0;
+int Fragile::copies_left = -1;
+
+// A batch that wraps around the array fails on its last copy: the run
+// already copied before the wrap must be destroyed, not leaked.
+void TestBatchThrowingCopy() {
+    {
+        std::vector<Fragile> in(4);
+        RingBuffer<Fragile> buffer(4);
+        ASSERT_EQ(3u, buffer.TryPushN(std::span<const Fragile>(in.data(), 3)));
+        std::vector<Fragile> out(3);
+        ASSERT_EQ(3u, buffer.TryPopN(out));
+
+        Fragile::copies_left = 3;
+        bool thrown = false;
+        try {
+            buffer.TryPushN(in);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        Fragile::copies_left = -1;
+        ASSERT_EQ(true, thrown);
+        ASSERT_EQ(0u, buffer.Size());
+        ASSERT_EQ(7, Fragile::live);
+
+        ASSERT_EQ(4u, buffer.TryPushN(in));
+        ASSERT_EQ(11, Fragile::live);
+    }
+    ASSERT_EQ(0, Fragile::live);
+}
+
 int main() {
     TestEmpty();
     TestPushAndPop();
     TestRandom();
+    TestWrapAround();
+    TestEmplace();
+    TestBatch();
+    TestBatchThrowingCopy();
     return 0;
 }
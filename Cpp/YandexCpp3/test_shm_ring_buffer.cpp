@@ -0,0 +1,146 @@
+#include <iostream>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shm_ring_buffer.h"
+
+#define ASSERT_EQ(expected, actual) { \
+    if (expected != actual) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": Assertion error" << std::endl; \
+        std::cerr << "\texpected: " << expected << " (= " << #expected << ")" << std::endl; \
+        std::cerr << "\tgot: " << actual << " (= " << #actual << ")" << std::endl; \
+        std::terminate(); \
+    } \
+}
+
+typedef ShmRingBuffer<int64_t> Ring;
+
+const std::string kName = "/test_shm_ring_buffer." + std::to_string(getpid());
+
+void TestAttach() {
+    ASSERT_EQ(true, Ring::Create(kName, 3));
+    ASSERT_EQ(false, Ring::Create(kName, 3));
+
+    Ring producer;
+    Ring consumer;
+    ASSERT_EQ(true, producer.Attach(kName, Ring::Role::kProducer));
+    ASSERT_EQ(true, consumer.Attach(kName, Ring::Role::kConsumer));
+    ASSERT_EQ(3, producer.Capacity());
+
+    Ring second;
+    ASSERT_EQ(false, second.Attach(kName, Ring::Role::kProducer));
+    ShmRingBuffer<int32_t> other_type;
+    ASSERT_EQ(false, other_type.Attach(kName, Ring::Role::kProducer));
+
+    // Each side may only do its own half.
+    int64_t i;
+    ASSERT_EQ(false, consumer.TryPush(7));
+    ASSERT_EQ(true, producer.TryPush(7));
+    ASSERT_EQ(false, producer.TryPop(&i));
+    ASSERT_EQ(true, consumer.TryPop(&i));
+    ASSERT_EQ(7, i);
+    ASSERT_EQ(false, second.TryPush(7));
+
+    for (int round = 0; round < 4; ++round) {
+        ASSERT_EQ(true, producer.TryPush(round));
+        ASSERT_EQ(true, producer.TryPush(round + 1));
+        ASSERT_EQ(true, producer.TryPush(round + 2));
+        ASSERT_EQ(false, producer.TryPush(round + 3));
+        ASSERT_EQ(true, consumer.TryPop(&i));
+        ASSERT_EQ(round, i);
+        ASSERT_EQ(true, consumer.TryPop(&i));
+        ASSERT_EQ(true, consumer.TryPop(&i));
+        ASSERT_EQ(round + 2, i);
+        ASSERT_EQ(false, consumer.TryPop(&i));
+    }
+
+    // Elements outlive the producer that pushed them.
+    ASSERT_EQ(true, producer.TryPush(42));
+    producer.Detach();
+    ASSERT_EQ(true, second.Attach(kName, Ring::Role::kProducer));
+    ASSERT_EQ(true, consumer.TryPop(&i));
+    ASSERT_EQ(42, i);
+
+    ASSERT_EQ(true, Ring::Unlink(kName));
+    ASSERT_EQ(false, Ring().Attach(kName, Ring::Role::kConsumer));
+}
+
+// A producer that dies without detaching gives its side up to the next
+// process, and everything it published stays in the ring.
+void TestCrashedPeer() {
+    ASSERT_EQ(true, Ring::Create(kName, 16));
+
+    pid_t child = fork();
+    if (child == 0) {
+        Ring producer;
+        if (!producer.Attach(kName, Ring::Role::kProducer)) {
+            _exit(1);
+        }
+        producer.TryPush(7);
+        _exit(0);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    Ring producer;
+    ASSERT_EQ(true, producer.Attach(kName, Ring::Role::kProducer));
+    ASSERT_EQ(true, producer.TryPush(8));
+
+    Ring consumer;
+    ASSERT_EQ(true, consumer.Attach(kName, Ring::Role::kConsumer));
+    int64_t i;
+    ASSERT_EQ(true, consumer.TryPop(&i));
+    ASSERT_EQ(7, i);
+    ASSERT_EQ(true, consumer.TryPop(&i));
+    ASSERT_EQ(8, i);
+    Ring::Unlink(kName);
+}
+
+void TestCrossProcess() {
+    const int64_t kElements = 1000000;
+    ASSERT_EQ(true, Ring::Create(kName, 256));
+
+    pid_t child = fork();
+    if (child == 0) {
+        Ring producer;
+        if (!producer.Attach(kName, Ring::Role::kProducer)) {
+            _exit(1);
+        }
+        for (int64_t i = 0; i < kElements;) {
+            if (producer.TryPush(i)) {
+                ++i;
+            } else {
+                sched_yield();
+            }
+        }
+        _exit(0);
+    }
+
+    Ring consumer;
+    ASSERT_EQ(true, consumer.Attach(kName, Ring::Role::kConsumer));
+    int64_t expected = 0;
+    int64_t element;
+    while (expected < kElements) {
+        if (consumer.TryPop(&element)) {
+            ASSERT_EQ(expected, element);
+            ++expected;
+        } else {
+            sched_yield();
+        }
+    }
+    int status;
+    waitpid(child, &status, 0);
+    ASSERT_EQ(0, WEXITSTATUS(status));
+    ASSERT_EQ(true, consumer.Empty());
+    Ring::Unlink(kName);
+}
+
+int main() {
+    TestAttach();
+    TestCrashedPeer();
+    TestCrossProcess();
+    return 0;
+}
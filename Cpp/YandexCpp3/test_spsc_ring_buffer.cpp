@@ -0,0 +1,118 @@
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring_buffer.h"
+
+#define ASSERT_EQ(expected, actual) { \
+    if (expected != actual) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": Assertion error" << std::endl; \
+        std::cerr << "\texpected: " << expected << " (= " << #expected << ")" << std::endl; \
+        std::cerr << "\tgot: " << actual << " (= " << #actual << ")" << std::endl; \
+        std::terminate(); \
+    } \
+}
+
+void TestPushAndPop() {
+    SpscRingBuffer<int> buffer(2);
+
+    int i;
+    ASSERT_EQ(true, buffer.Empty());
+    ASSERT_EQ(true, buffer.TryPush(0));
+    ASSERT_EQ(true, buffer.TryPush(1));
+    ASSERT_EQ(false, buffer.TryPush(2));
+    ASSERT_EQ(2, buffer.Size());
+
+    ASSERT_EQ(true, buffer.TryPop(&i));
+    ASSERT_EQ(0, i);
+    ASSERT_EQ(true, buffer.TryPush(2));
+    ASSERT_EQ(true, buffer.TryPop(&i));
+    ASSERT_EQ(1, i);
+    ASSERT_EQ(true, buffer.TryPop(&i));
+    ASSERT_EQ(2, i);
+    ASSERT_EQ(false, buffer.TryPop(&i));
+    ASSERT_EQ(true, buffer.Empty());
+}
+
+void TestMoveOnly() {
+    SpscRingBuffer<std::unique_ptr<int>> buffer(3);
+    ASSERT_EQ(true, buffer.TryEmplace(new int(1)));
+    ASSERT_EQ(true, buffer.TryPush(std::unique_ptr<int>(new int(2))));
+
+    std::unique_ptr<int> p;
+    ASSERT_EQ(true, buffer.TryPop(&p));
+    ASSERT_EQ(1, *p);
+}
+
+// Run under ThreadSanitizer by the test_spsc_ring_buffer_tsan target.
+void TestProducerConsumer() {
+    const int kElements = 1000000;
+    SpscRingBuffer<std::unique_ptr<int>> buffer(64);
+
+    std::thread producer([&buffer] {
+        for (int i = 0; i < kElements;) {
+            if (buffer.TryEmplace(new int(i))) {
+                ++i;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int expected = 0;
+    std::unique_ptr<int> element;
+    while (expected < kElements) {
+        if (buffer.TryPop(&element)) {
+            ASSERT_EQ(expected, *element);
+            ++expected;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    ASSERT_EQ(true, buffer.Empty());
+}
+
+void TestBatchProducerConsumer() {
+    const int kElements = 1000000;
+    SpscRingBuffer<int> buffer(100);
+
+    std::thread producer([&buffer] {
+        std::vector<int> batch(37);
+        for (int i = 0; i < kElements;) {
+            size_t size = std::min<size_t>(batch.size(), kElements - i);
+            for (size_t j = 0; j < size; ++j) {
+                batch[j] = i + j;
+            }
+            size_t pushed = buffer.TryPushN(std::span<const int>(batch.data(), size));
+            if (pushed == 0) {
+                std::this_thread::yield();
+            }
+            i += pushed;
+        }
+    });
+
+    int expected = 0;
+    std::vector<int> batch(53);
+    while (expected < kElements) {
+        size_t popped = buffer.TryPopN(batch);
+        for (size_t j = 0; j < popped; ++j) {
+            ASSERT_EQ(expected, batch[j]);
+            ++expected;
+        }
+        if (popped == 0) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    ASSERT_EQ(true, buffer.Empty());
+}
+
+int main() {
+    TestPushAndPop();
+    TestMoveOnly();
+    TestProducerConsumer();
+    TestBatchProducerConsumer();
+    return 0;
+}
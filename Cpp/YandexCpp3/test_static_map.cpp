@@ -1,5 +1,11 @@
 #include <cassert>
 #include <iostream>
+#include <random>
+#include <fstream>
+#include <iterator>
+#include <map>
+
+#include <unistd.h>
 
 #include "static_map.h"
 
@@ -53,10 +59,262 @@ void TestSpeed() {
     }
 }
 
+void TestMissingKeys() {
+    std::vector<std::pair<std::string, std::string>> items;
+    for (int i = 0; i < 10000; i += 2) {
+        items.emplace_back("key" + std::to_string(i), std::to_string(i));
+    }
+    items.emplace_back("", "empty");
+    items.emplace_back("key0", "duplicate");
+    StaticMap map(items);
+
+    std::string value;
+    for (int i = 0; i < 10000; ++i) {
+        bool expected = i % 2 == 0;
+        ASSERT_EQ(expected, map.Find("key" + std::to_string(i), &value));
+    }
+    ASSERT_EQ(true, map.Find("key0", &value));
+    ASSERT_EQ("0", value);
+    ASSERT_EQ(true, map.Find("", &value));
+    ASSERT_EQ("empty", value);
+    ASSERT_EQ(false, map.Find("key", &value));
+    ASSERT_EQ(false, map.Find(std::string("key0\0", 5), &value));
+}
+
+void TestImage() {
+    std::string path = "/tmp/test_static_map." + std::to_string(getpid());
+    std::vector<std::pair<std::string, std::string>> items;
+    for (int i = 0; i < 1000; ++i) {
+        items.emplace_back(std::to_string(i), std::string(i % 50, 'v'));
+    }
+    ASSERT_EQ(true, StaticMap::Write(items, path));
+
+    std::optional<StaticMap> opened = StaticMap::Open(path);
+    ASSERT_EQ(true, opened.has_value());
+    StaticMap map = std::move(*opened);
+    opened.reset();
+    ASSERT_EQ(1000, map.Size());
+
+    std::string value;
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(true, map.Find(std::to_string(i), &value));
+        ASSERT_EQ(std::string(i % 50, 'v'), value);
+    }
+    ASSERT_EQ(false, map.Find("1000", &value));
+
+    // Truncated and foreign files are refused.
+    ASSERT_EQ(0, truncate(path.c_str(), 100));
+    ASSERT_EQ(false, StaticMap::Open(path).has_value());
+    std::ofstream(path) << "not a map";
+    ASSERT_EQ(false, StaticMap::Open(path).has_value());
+    ASSERT_EQ(false, StaticMap::Open(path + ".missing").has_value());
+
+    ASSERT_EQ(true, StaticMap::Write({}, path));
+    opened = StaticMap::Open(path);
+    ASSERT_EQ(true, opened.has_value());
+    ASSERT_EQ(false, opened->Find("", &value));
+    unlink(path.c_str());
+}
+
+// Overwrites every 8 bytes of an image in turn with 0xff. Open must
+// either refuse the file or give a map whose lookups stay in bounds.
+void TestDamagedImage() {
+    std::string path = "/tmp/test_static_map_damaged." + std::to_string(getpid());
+    std::vector<std::pair<std::string, std::string>> items;
+    for (int i = 0; i < 200; ++i) {
+        items.emplace_back("key/" + std::to_string(i), std::to_string(i));
+    }
+    for (auto layout : {StaticMap::Layout::kPerfectHash, StaticMap::Layout::kEytzinger}) {
+        for (auto encoding :
+             {StaticMap::KeyEncoding::kPlain, StaticMap::KeyEncoding::kFrontCoded}) {
+            ASSERT_EQ(true, StaticMap::Write(items, path, layout, encoding));
+            std::string image;
+            {
+                std::ifstream input(path, std::ios::binary);
+                image.assign(std::istreambuf_iterator<char>(input),
+                             std::istreambuf_iterator<char>());
+            }
+            for (size_t offset = 0; offset < image.size(); offset += 8) {
+                std::string damaged = image;
+                for (size_t i = offset; i < std::min(offset + 8, image.size()); ++i) {
+                    damaged[i] = '\xff';
+                }
+                std::ofstream(path, std::ios::binary) << damaged;
+                std::optional<StaticMap> map = StaticMap::Open(path);
+                if (!map) {
+                    continue;
+                }
+                std::string value;
+                for (const auto& item : items) {
+                    map->Find(item.first, &value);
+                }
+                map->ForEachWithPrefix("key/1", [](auto, auto) {});
+            }
+        }
+    }
+    unlink(path.c_str());
+}
+
+// Keys that share long prefixes, are prefixes of each other or contain
+// zero bytes, so the Eytzinger search has to break prefix ties.
+void TestLayouts() {
+    std::vector<std::string> keys = {"", "a", std::string("a\0", 2), "ab", "abcdefgh",
+                                     "abcdefgh\xff", "abcdefghi", "zzzzzzzzzzzz"};
+    for (int i = 0; i < 3000; ++i) {
+        keys.push_back("common/prefix/" + std::to_string(i * 7));
+    }
+    std::vector<std::pair<std::string, std::string>> items;
+    for (const auto& key : keys) {
+        items.emplace_back(key, "value of " + key);
+    }
+    std::mt19937 generator(42);
+    std::shuffle(items.begin(), items.end(), generator);
+
+    std::string path = "/tmp/test_static_map_layouts." + std::to_string(getpid());
+    for (auto layout : {StaticMap::Layout::kPerfectHash, StaticMap::Layout::kEytzinger}) {
+        for (auto encoding :
+             {StaticMap::KeyEncoding::kPlain, StaticMap::KeyEncoding::kFrontCoded}) {
+            ASSERT_EQ(true, StaticMap::Write(items, path, layout, encoding));
+            std::optional<StaticMap> opened = StaticMap::Open(path);
+            ASSERT_EQ(true, opened.has_value());
+            StaticMap built(items, layout, 0, encoding);
+            for (const StaticMap* map : {&built, &*opened}) {
+                bool same_layout = map->GetLayout() == layout &&
+                                   map->GetKeyEncoding() == encoding;
+                ASSERT_EQ(true, same_layout);
+                std::string value;
+                for (const auto& key : keys) {
+                    ASSERT_EQ(true, map->Find(key, &value));
+                    ASSERT_EQ("value of " + key, value);
+                }
+                for (int i = 0; i < 3000; ++i) {
+                    bool expected = i % 7 == 0;
+                    ASSERT_EQ(expected, map->Find("common/prefix/" + std::to_string(i), &value));
+                }
+                ASSERT_EQ(false, map->Find("abcdefg", &value));
+                ASSERT_EQ(false, map->Find("abcdefgh\x01", &value));
+                ASSERT_EQ(false, map->Find("zzzzzzzzzzzzz", &value));
+                ASSERT_EQ(false, map->Find(std::string("\0", 1), &value));
+            }
+        }
+    }
+    unlink(path.c_str());
+
+    StaticMap empty({}, StaticMap::Layout::kEytzinger);
+    std::string value;
+    ASSERT_EQ(false, empty.Find("", &value));
+}
+
+// URL-like keys, checked against a std::map scan for every layout and key
+// encoding and for bounds that fall inside, between and outside of blocks.
+void TestRanges() {
+    std::map<std::string, std::string> expected;
+    for (int i = 0; i < 500; ++i) {
+        std::string host = "https://host" + std::to_string(i % 7) + ".example.com/";
+        expected[host + "page/" + std::to_string(i)] = std::to_string(i);
+        expected[host + "page/" + std::to_string(i) + "/edit"] = "edit " + std::to_string(i);
+    }
+    expected[""] = "empty";
+    expected["\xff\xff"] = "high";
+    std::vector<std::pair<std::string, std::string>> items(expected.begin(), expected.end());
+
+    std::vector<std::string> bounds = {"", "h", "https://host3", "https://host3.example.com/page/1",
+                                       "https://host3.example.com/page/10/edit",
+                                       "https://host6.example.com/page/99", "i", "\xff",
+                                       "\xff\xff\xff"};
+    for (const auto& item : items) {
+        bounds.push_back(item.first);
+    }
+    for (auto layout : {StaticMap::Layout::kPerfectHash, StaticMap::Layout::kEytzinger}) {
+        for (auto encoding :
+             {StaticMap::KeyEncoding::kPlain, StaticMap::KeyEncoding::kFrontCoded}) {
+            StaticMap map(items, layout, 0, encoding);
+            for (size_t i = 0; i < bounds.size(); i += 3) {
+                for (size_t j = 0; j < bounds.size(); j += 37) {
+                    std::vector<std::pair<std::string, std::string>> found;
+                    map.ForEachInRange(bounds[i], bounds[j], [&found](auto key, auto value) {
+                        found.emplace_back(key, value);
+                    });
+                    std::vector<std::pair<std::string, std::string>> scanned;
+                    for (const auto& item : items) {
+                        if (item.first >= bounds[i] && item.first < bounds[j]) {
+                            scanned.push_back(item);
+                        }
+                    }
+                    bool same = found == scanned;
+                    ASSERT_EQ(true, same);
+                }
+            }
+            for (const auto& prefix : bounds) {
+                std::vector<std::pair<std::string, std::string>> found;
+                map.ForEachWithPrefix(prefix, [&found](auto key, auto value) {
+                    found.emplace_back(key, value);
+                });
+                std::vector<std::pair<std::string, std::string>> scanned;
+                for (const auto& item : items) {
+                    if (item.first.starts_with(prefix)) {
+                        scanned.push_back(item);
+                    }
+                }
+                bool same = found == scanned;
+                ASSERT_EQ(true, same);
+            }
+        }
+    }
+}
+
+void TestBloomFilter() {
+    std::vector<std::pair<std::string, std::string>> items;
+    for (int i = 0; i < 20000; ++i) {
+        items.emplace_back("present/" + std::to_string(i), std::to_string(i));
+    }
+    for (auto layout : {StaticMap::Layout::kPerfectHash, StaticMap::Layout::kEytzinger}) {
+        for (double rate : {0.1, 0.01, 0.001}) {
+            StaticMap map(items, layout, rate);
+            std::string value;
+            for (const auto& item : items) {
+                ASSERT_EQ(true, map.Find(item.first, &value));
+                ASSERT_EQ(item.second, value);
+            }
+            for (const auto& item : items) {
+                ASSERT_EQ(true, map.MayContain(item.first));
+            }
+
+            const int kMisses = 100000;
+            int passed = 0;
+            for (int i = 0; i < kMisses; ++i) {
+                std::string key = "absent/" + std::to_string(i);
+                ASSERT_EQ(false, map.Find(key, &value));
+                passed += map.MayContain(key);
+            }
+            double false_positives = passed / double(kMisses);
+            bool near_rate = false_positives < 1.5 * rate;
+            ASSERT_EQ(true, near_rate);
+
+            StaticMap moved = std::move(map);
+            ASSERT_EQ(false, moved.Find("absent/0", &value));
+            ASSERT_EQ(true, moved.MayContain(items.front().first));
+        }
+    }
+
+    StaticMap unfiltered(items);
+    std::string value;
+    ASSERT_EQ(false, unfiltered.Find("absent", &value));
+    ASSERT_EQ(true, unfiltered.MayContain("absent"));
+    StaticMap empty({}, StaticMap::Layout::kPerfectHash, 0.01);
+    ASSERT_EQ(false, empty.Find("", &value));
+}
+
 int main() {
     TestEmptyMap();
     TestSmallMap();
     TestSpeed();
+    TestMissingKeys();
+    TestImage();
+    TestDamagedImage();
+    TestLayouts();
+    TestRanges();
+    TestBloomFilter();
 
     return 0;
 }
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "readers.h"
+#include "readers_util.h"
+
+// ReadAll as it was: 128-byte reads appended to the result.
+std::string ChunkedReadAll(Reader* in) {
+    const size_t CHUNK_SIZE = 128;
+
+    std::string buf;
+    std::string chunk;
+    while (true) {
+        chunk.resize(CHUNK_SIZE);
+        size_t read_res = in->Read(&(chunk[0]), chunk.size());
+        if (read_res == 0) break;
+
+        chunk.resize(read_res);
+        buf += chunk;
+    }
+
+    return buf;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Reads @in to the end in reads of @len bytes and returns how many bytes
+// there were.
+size_t Drain(Reader* in, size_t len) {
+    std::string buf(len, '\0');
+    size_t total = 0;
+    for (size_t read; (read = in->Read(&buf[0], len)) != 0; ) {
+        total += read;
+    }
+    return total;
+}
+
+// Prints MB/s of the old and the new ReadAll over a file of @size bytes
+// (already in the page cache), of a stream without a size hint, and of
+// small reads with and without a BufferedReader.
+void Bench(size_t size) {
+    FILE* file = std::tmpfile();
+    std::string data(size, 'x');
+    std::fwrite(data.data(), 1, data.size(), file);
+    std::fflush(file);
+    int fd = fileno(file);
+    double mb = size / double(1 << 20);
+
+    auto timed = [&](const std::function<size_t()>& read) {
+        ::lseek(fd, 0, SEEK_SET);
+        auto start = std::chrono::steady_clock::now();
+        if (read() != size) {
+            std::cout << "short read" << std::endl;
+        }
+        return mb / Seconds(start);
+    };
+
+    double chunked = timed([&] {
+        FdReader in(fd);
+        return ChunkedReadAll(&in).size();
+    });
+    double hinted = timed([&] {
+        FdReader in(fd);
+        return ReadAll(&in).size();
+    });
+    double unhinted = timed([&] {
+        LimitReader in(std::unique_ptr<Reader>(new FdReader(fd)), size);
+        return ReadAll(&in).size();
+    });
+    double small = timed([&] {
+        FdReader in(fd);
+        return Drain(&in, 64);
+    });
+    double buffered = timed([&] {
+        BufferedReader in(std::unique_ptr<Reader>(new FdReader(fd)));
+        return Drain(&in, 64);
+    });
+    std::fclose(file);
+
+    std::cout << size / (1 << 20) << " MB file: ReadAll by 128 B " << chunked
+              << " MB/s, with size hint " << hinted << " MB/s, without " << unhinted
+              << " MB/s; 64 B reads " << small << " MB/s, buffered " << buffered
+              << " MB/s" << std::endl;
+}
+
+int main() {
+    for (size_t size : {1 << 20, 64 << 20, 512 << 20}) {
+        Bench(size);
+    }
+    return 0;
+}
@@ -2,7 +2,9 @@
 
 #include <string>
 #include <algorithm>
+#include <cstring>
 
+#include <sys/stat.h>
 #include <unistd.h>
 
 class Reader {
@@ -15,21 +17,32 @@ class Reader {
     // Возвращаемое значение 0 означает конец потока.
 
     virtual size_t Read(char* buf, size_t len) = 0;
+
+    // Сколько байт, вероятно, осталось в потоке; 0, если неизвестно.
+    // Только подсказка: поток может оказаться и длиннее, и короче.
+    virtual size_t SizeHint() const {
+        return 0;
+    }
 };
 
-std::string ReadAll(Reader* in) {
-    const size_t CHUNK_SIZE = 128;
+// Читает весь поток прямо в результат.
+// Начальный размер буфера равен подсказке плюс один байт, чтобы при верной
+// подсказке хватило одного пустого чтения. Заполненный буфер удваивается.
+inline std::string ReadAll(Reader* in) {
+    const size_t kInitialSize = 4096;
 
-    std::string buf;
-    std::string chunk;
+    std::string buf(std::max(kInitialSize, in->SizeHint() + 1), '\0');
+    size_t size = 0;
     while (true) {
-        chunk.resize(CHUNK_SIZE);
-        size_t read_res = in->Read(&(chunk[0]), chunk.size());
+        if (size == buf.size()) {
+            buf.resize(buf.size() * 2);
+        }
+        size_t read_res = in->Read(&buf[size], buf.size() - size);
         if (read_res == 0) break;
 
-        chunk.resize(read_res);
-        buf += chunk;
+        size += read_res;
     }
+    buf.resize(size);
 
     return buf;
 }
@@ -40,12 +53,15 @@ class StringReader : public Reader {
 
     virtual size_t Read(char* buf, size_t len) override {
         size_t read_len = std::min(len, data_.size() - pos_);
-        for (size_t i = 0; i < read_len; ++i) {
-            buf[i] = data_[pos_++];
-        }
+        std::memcpy(buf, data_.data() + pos_, read_len);
+        pos_ += read_len;
         return read_len;
     }
 
+    virtual size_t SizeHint() const override {
+        return data_.size() - pos_;
+    }
+
  private:
     std::string data_;
     size_t pos_ = 0;
@@ -63,6 +79,16 @@ class FdReader : public Reader {
         return res;
     }
 
+    // Остаток обычного файла; у pipe и сокетов размера нет.
+    virtual size_t SizeHint() const override {
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return 0;
+        }
+        off_t pos = ::lseek(fd_, 0, SEEK_CUR);
+        return pos == -1 || pos >= st.st_size ? 0 : st.st_size - pos;
+    }
+
  private:
     int fd_;
 };
@@ -1,5 +1,8 @@
+#pragma once
+
 #include <vector>
 #include <memory>
+#include <cstring>
 
 #include "readers.h"
 
@@ -87,3 +90,38 @@ public:
         return red_len;
     }
 };
+
+// Reads the underlying reader in chunks of @buffer_size, so that many small
+// Read calls cost one underlying Read (a syscall for FdReader) per buffer.
+// Reads of at least a buffer go straight to the caller's memory.
+class BufferedReader : public Reader {
+private:
+    std::unique_ptr<Reader> reader_;
+    std::vector<char> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+
+public:
+    static const size_t kDefaultBufferSize = 64 << 10;
+
+    BufferedReader(std::unique_ptr<Reader> reader, size_t buffer_size = kDefaultBufferSize)
+        : reader_(std::move(reader)), buffer_(std::max<size_t>(buffer_size, 1)) {}
+
+    virtual size_t Read(char* buf, size_t len) override {
+        if (begin_ == end_) {
+            if (len >= buffer_.size()) {
+                return reader_->Read(buf, len);
+            }
+            begin_ = 0;
+            end_ = reader_->Read(buffer_.data(), buffer_.size());
+        }
+        len = std::min(len, end_ - begin_);
+        std::memcpy(buf, buffer_.data() + begin_, len);
+        begin_ += len;
+        return len;
+    }
+
+    virtual size_t SizeHint() const override {
+        return end_ - begin_ + reader_->SizeHint();
+    }
+};
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cassert>
+#include <cstdio>
 
 #include "readers.h"
 #include "readers_util.h"
@@ -99,12 +100,120 @@ void TestHexReader() {
     ASSERT_EQ(answer, ReadAll(&h3));
 }
 
+// Hands out at most @chunk bytes per Read and counts the calls.
+class ChunkedReader : public Reader {
+public:
+    ChunkedReader(const std::string& data, size_t chunk, size_t* calls)
+        : data_(data), chunk_(chunk), calls_(calls) {}
+
+    virtual size_t Read(char* buf, size_t len) override {
+        ++*calls_;
+        return data_.Read(buf, std::min(len, chunk_));
+    }
+
+    virtual size_t SizeHint() const override {
+        return data_.SizeHint();
+    }
+
+private:
+    StringReader data_;
+    size_t chunk_;
+    size_t* calls_;
+};
+
+void TestReadAll() {
+    // the size hint lets ReadAll take everything in one read and one empty one
+    std::string big_string(1 << 20, 'x');
+    size_t calls = 0;
+    ChunkedReader r1(big_string, big_string.size(), &calls);
+    ASSERT_EQ(big_string, ReadAll(&r1));
+    ASSERT_EQ(2u, calls);
+
+    // without one (LimitReader has none) the buffer doubles as it fills
+    calls = 0;
+    LimitReader r2(std::unique_ptr<Reader>(new ChunkedReader(big_string, 1 << 30, &calls)),
+                   big_string.size());
+    ASSERT_EQ(big_string, ReadAll(&r2));
+    bool few_calls = calls < 20;
+    ASSERT_EQ(true, few_calls);
+}
+
+void TestFdReader() {
+    std::string data;
+    for (int i = 0; i < 100000; ++i) {
+        data += std::to_string(i);
+    }
+    FILE* file = std::tmpfile();
+    std::fwrite(data.data(), 1, data.size(), file);
+    std::fflush(file);
+    int fd = fileno(file);
+
+    ::lseek(fd, 0, SEEK_SET);
+    FdReader r1(fd);
+    ASSERT_EQ(data.size(), r1.SizeHint());
+    ASSERT_EQ(data, ReadAll(&r1));
+    ASSERT_EQ(0u, r1.SizeHint());
+
+    // the hint counts from the current offset
+    ::lseek(fd, 10, SEEK_SET);
+    FdReader r2(fd);
+    ASSERT_EQ(data.size() - 10, r2.SizeHint());
+    ASSERT_EQ(data.substr(10), ReadAll(&r2));
+    std::fclose(file);
+
+    int fds[2];
+    ASSERT_EQ(0, ::pipe(fds));
+    ASSERT_EQ(3, ::write(fds[1], "abc", 3));
+    ::close(fds[1]);
+    FdReader r3(fds[0]);
+    ASSERT_EQ(0u, r3.SizeHint());
+    ASSERT_EQ("abc", ReadAll(&r3));
+    ::close(fds[0]);
+}
+
+void TestBufferedReader() {
+    BufferedReader b1(MakeR(""));
+    ASSERT_EQ("", ReadAll(&b1));
+
+    std::string data;
+    for (int i = 0; i < 10000; ++i) {
+        data += std::to_string(i);
+    }
+    BufferedReader b2(MakeR(data));
+    ASSERT_EQ(data.size(), b2.SizeHint());
+    ASSERT_EQ(data, ReadAll(&b2));
+
+    // small reads are served from the buffer
+    size_t calls = 0;
+    BufferedReader b3(std::unique_ptr<Reader>(new ChunkedReader(data, 1000, &calls)), 100);
+    std::string result;
+    char buf[7];
+    for (size_t len; (len = b3.Read(buf, sizeof(buf))) != 0; ) {
+        result.append(buf, len);
+    }
+    ASSERT_EQ(data, result);
+    ASSERT_EQ((data.size() + 99) / 100 + 1, calls);
+
+    // reads of a whole buffer go past it, after what is left in it
+    calls = 0;
+    BufferedReader b4(std::unique_ptr<Reader>(new ChunkedReader(data, 1000, &calls)), 100);
+    ASSERT_EQ(7u, b4.Read(buf, sizeof(buf)));
+    ASSERT_EQ(data.size() - 7, b4.SizeHint());
+    std::string rest(500, '\0');
+    ASSERT_EQ(93u, b4.Read(&rest[0], rest.size()));
+    ASSERT_EQ(500u, b4.Read(&rest[0], rest.size()));
+    ASSERT_EQ(data.substr(100, 500), rest);
+    ASSERT_EQ(2u, calls);
+}
 
 int main() {
     TestStringReader();
     TestLimitReader();
     TestTeeReader();
     TestHexReader();
+    TestReadAll();
+    TestFdReader();
+    TestBufferedReader();
 
     return 0;
 }